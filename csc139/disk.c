@@ -0,0 +1,807 @@
+// Native engine for disk.py: the same disk, timing model, policies and
+// output (without the -G graphics), fast enough for million-request traces.
+//
+// build: gcc -O2 -o disk disk.c -lm
+//
+// disk.py advances a clock one tick at a time and, for SATF, estimates every
+// request in the scheduling window each time it picks the next one. Here:
+//  - pending requests are indexed by block, in arrival order, so choosing the
+//    next request costs one estimate per block that has work rather than one
+//    per queued request. All requests for a block have the same estimate, and
+//    the earliest of them is the one disk.py would pick
+//  - the platter angle only depends on the tick (it restarts from exactly 0.0
+//    every time it passes 360), so the ticks at which the head lines up with
+//    each block are found once and rotational waits become a lookup instead
+//    of a tick-by-tick loop. Seeks still move the arm one tick at a time, as
+//    the arm position carries floating point error from seek to seek
+// Every time is computed with the same double arithmetic as disk.py, so the
+// -c output is identical.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#define MAXTRACKS 1000
+#define TRACKS 3
+#define TRACK_WIDTH 40
+#define WIDTH 500
+
+enum { STATE_NULL, STATE_SEEK, STATE_ROTATE, STATE_XFER, STATE_DONE };
+enum { FIFO, SSTF, SATF, BSATF };
+
+// options, as in disk.py
+long long seed = 0;
+char *addr = "-1", *addrDesc = "5,-1,0";
+char *seekSpeedText = "1", *rotateSpeedText = "1";
+char *policyName = "FIFO";
+long window = -1;
+long skew = 0;
+char *zoning = "30,30,30";
+bool graphics = false;
+char *lateAddr = "-1", *lateAddrDesc = "0,-1,0";
+bool compute = false;
+
+int policy;
+double seekSpeed, rotateSpeed;
+
+// block layout
+int blockAngleOffset[TRACKS]; // half the angle between blocks on each track
+int *blockTrack, *blockAngle;
+int blockCount, maxBlock;
+int trackBegin[TRACKS], trackEnd[TRACKS];
+int tracks[TRACKS] = { 140, 100, 60 }; // distance of each track from the spindle
+
+// requests, in the order they join the queue
+int *requests, requestTotal;
+int *lateRequests, lateTotal, lateCount;
+int *queueBlock, queueLength;
+
+// pending requests inside the scheduling window, one list per block
+int *blockHead, *blockTail, *nextInBlock;
+int admitted; // queue entries before this have been added to the lists
+int pendingOnTrack[TRACKS];
+
+// the platter: angle after t ticks is angles[t % period]
+double *angles;
+long period;
+long *matchStart; // per target angle, -1 until built, else offset into matches
+long *matchCount;
+long *matches;
+long matchesUsed, matchesCapacity;
+
+// disk state
+long timer = 0;
+int armTrack = 0, armTarget;
+double armX1, armTargetX1, armSpeed, armSpeedBase;
+double spindleX;
+int state = STATE_NULL;
+int currentBlock = -1, currentIndex = -1;
+int requestCount = 0;
+long currWindow, fairWindow;
+long seekBegin, rotBegin, xferBegin;
+long seekTotal, rotTotal, xferTotal;
+bool isDone = false;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Python's random(), so -s gives the same requests as disk.py
+//
+#define MT_N 624
+#define MT_M 397
+uint32_t mt[MT_N];
+int mti = MT_N + 1;
+
+void initGenrand(uint32_t s) {
+    mt[0] = s;
+    for (mti = 1; mti < MT_N; mti++) {
+        mt[mti] = 1812433253U * (mt[mti - 1] ^ (mt[mti - 1] >> 30)) + mti;
+    }
+}
+
+void initByArray(uint32_t key[], int keyLength) {
+    int i = 1, j = 0;
+    initGenrand(19650218U);
+    for (int k = MT_N > keyLength ? MT_N : keyLength; k; k--) {
+        mt[i] = (mt[i] ^ ((mt[i - 1] ^ (mt[i - 1] >> 30)) * 1664525U)) + key[j] + j;
+        i++;
+        j++;
+        if (i >= MT_N) {
+            mt[0] = mt[MT_N - 1];
+            i = 1;
+        }
+        if (j >= keyLength) {
+            j = 0;
+        }
+    }
+    for (int k = MT_N - 1; k; k--) {
+        mt[i] = (mt[i] ^ ((mt[i - 1] ^ (mt[i - 1] >> 30)) * 1566083941U)) - i;
+        i++;
+        if (i >= MT_N) {
+            mt[0] = mt[MT_N - 1];
+            i = 1;
+        }
+    }
+    mt[0] = 0x80000000U;
+}
+
+uint32_t genrandInt32() {
+    static const uint32_t mag01[2] = { 0, 0x9908b0dfU };
+    uint32_t y;
+
+    if (mti >= MT_N) {
+        int kk;
+        for (kk = 0; kk < MT_N - MT_M; kk++) {
+            y = (mt[kk] & 0x80000000U) | (mt[kk + 1] & 0x7fffffffU);
+            mt[kk] = mt[kk + MT_M] ^ (y >> 1) ^ mag01[y & 1];
+        }
+        for (; kk < MT_N - 1; kk++) {
+            y = (mt[kk] & 0x80000000U) | (mt[kk + 1] & 0x7fffffffU);
+            mt[kk] = mt[kk + (MT_M - MT_N)] ^ (y >> 1) ^ mag01[y & 1];
+        }
+        y = (mt[MT_N - 1] & 0x80000000U) | (mt[0] & 0x7fffffffU);
+        mt[MT_N - 1] = mt[MT_M - 1] ^ (y >> 1) ^ mag01[y & 1];
+        mti = 0;
+    }
+
+    y = mt[mti++];
+    y ^= y >> 11;
+    y ^= (y << 7) & 0x9d2c5680U;
+    y ^= (y << 15) & 0xefc60000U;
+    y ^= y >> 18;
+    return y;
+}
+
+// random.seed(n) for an integer n keys the generator with the 32-bit words of |n|
+void randomSeed(long long n) {
+    unsigned long long value = n < 0 ? -(unsigned long long) n : (unsigned long long) n;
+    uint32_t key[2] = { (uint32_t) value, (uint32_t) (value >> 32) };
+    initByArray(key, key[1] != 0 ? 2 : 1);
+}
+
+double randomDouble() {
+    uint32_t a = genrandInt32() >> 5, b = genrandInt32() >> 6;
+    return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// setup
+//
+void *checkedMalloc(size_t size) {
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    return ptr;
+}
+
+// Python's %, never negative
+int pyMod(long a, int b) {
+    long r = a % b;
+    return r < 0 ? r + b : r;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-s seed] [-a addr] [-A addrDesc] [-S seekSpeed] [-R rotSpeed]\n"
+                    "       [-p FIFO|SSTF|SATF|BSATF] [-w window] [-o skew] [-z zoning]\n"
+                    "       [-l lateAddr] [-L lateAddrDesc] [-c]\n", program);
+    exit(1);
+}
+
+long parseLong(const char *text) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    while (*end == ' ' || *end == '\t' || *end == '\n') {
+        end++;
+    }
+    if (end == text || *end != '\0') {
+        printf("invalid integer value: '%s'\n", text);
+        exit(1);
+    }
+    return value;
+}
+
+double parseDouble(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || *end != '\0') {
+        printf("could not convert string to float: '%s'\n", text);
+        exit(1);
+    }
+    return value;
+}
+
+void printAddrDescMessage(const char *value) {
+    printf("Bad address description (%s)\n", value);
+    printf("The address description must be a comma-separated list of length three, without spaces.\n");
+    printf("For example, \"10,100,0\" would indicate that 10 addresses should be generated, with\n");
+    printf("100 as the maximum value, and 0 as the minumum. A max of -1 means just use the highest\n");
+    printf("possible value as the max address to generate.\n");
+    exit(1);
+}
+
+void initBlockLayout() {
+    char *zones = strdup(zoning), *zone[TRACKS + 1];
+    int count = 0;
+    for (char *field = strtok(zones, ","); field != NULL && count <= TRACKS; field = strtok(NULL, ",")) {
+        zone[count++] = field;
+    }
+    if (count != TRACKS) {
+        printf("zoning must give an angle for each of the %d tracks\n", TRACKS);
+        exit(1);
+    }
+    for (int i = 0; i < TRACKS; i++) {
+        printf("z %d %s\n", i, zone[i]);
+        blockAngleOffset[i] = (int) (parseLong(zone[i]) / 2);
+    }
+    free(zones);
+
+    blockCount = 0;
+    for (int track = 0; track < TRACKS; track++) {
+        int angleOffset = 2 * blockAngleOffset[track];
+        if (angleOffset <= 0) {
+            printf("zone angle for track %d must be at least 2\n", track);
+            exit(1);
+        }
+        blockCount += (360 + angleOffset - 1) / angleOffset;
+    }
+    blockTrack = checkedMalloc(blockCount * sizeof(int));
+    blockAngle = checkedMalloc(blockCount * sizeof(int));
+
+    // outer track first; each track further in is skewed by one more skew
+    int block = 0, pblock = 0;
+    for (int track = 0; track < TRACKS; track++) {
+        int angleOffset = 2 * blockAngleOffset[track];
+        long trackSkew = track * skew;
+        for (int angle = 0; angle < 360; angle += angleOffset) {
+            block = angle / angleOffset + pblock;
+            if (track == 0) {
+                printf("%d %d %d\n", track, angleOffset, block);
+            } else {
+                printf("%d %ld %d %d\n", track, trackSkew, angleOffset, block);
+            }
+            blockTrack[block] = track;
+            blockAngle[block] = (int) (angle + angleOffset * trackSkew);
+        }
+        trackBegin[track] = pblock;
+        trackEnd[track] = block;
+        if (track < TRACKS - 1) {
+            pblock = block + 1;
+        }
+    }
+    maxBlock = pblock; // as in disk.py: the first block of the inner track
+
+    // adjust angle to starting position relative
+    for (int i = 0; i < blockCount; i++) {
+        blockAngle[i] = pyMod(blockAngle[i] + 180L, 360);
+    }
+}
+
+// fills *list with the requests addr or addrDesc describe; returns the count
+int makeRequests(const char *addrList, const char *desc, int **list) {
+    if (strcmp(addrList, "-1") == 0) {
+        char *copy = strdup(desc), *fields[4];
+        int count = 0;
+        for (char *field = strtok(copy, ","); field != NULL && count < 4; field = strtok(NULL, ",")) {
+            fields[count++] = field;
+        }
+        if (count != 3 || strchr(desc, ' ') != NULL) {
+            printAddrDescMessage(desc);
+        }
+        long numRequests = parseLong(fields[0]), maxRequest = parseLong(fields[1]), minRequest = parseLong(fields[2]);
+        free(copy);
+        if (maxRequest == -1) {
+            maxRequest = maxBlock;
+        }
+        if (numRequests < 0) {
+            numRequests = 0;
+        }
+        *list = checkedMalloc(numRequests * sizeof(int));
+        for (long i = 0; i < numRequests; i++) {
+            (*list)[i] = (int) (randomDouble() * maxRequest) + minRequest;
+        }
+        return numRequests;
+    }
+
+    int count = 1;
+    for (const char *p = addrList; *p != '\0'; p++) {
+        count += *p == ',';
+    }
+    *list = checkedMalloc(count * sizeof(int));
+    char *copy = strdup(addrList), *field = copy;
+    for (int i = 0; i < count; i++) {
+        char *comma = strchr(field, ',');
+        if (comma != NULL) {
+            *comma = '\0';
+        }
+        (*list)[i] = (int) parseLong(field);
+        field = comma + 1;
+    }
+    free(copy);
+    return count;
+}
+
+// print a request list the way Python prints the list disk.py keeps: numbers
+// for generated requests, the original strings for ones given with -a/-l
+void printRequests(const char *label, const char *addrList, int *list, int count) {
+    printf("%s [", label);
+    if (strcmp(addrList, "-1") == 0) {
+        for (int i = 0; i < count; i++) {
+            printf(i ? ", %d" : "%d", list[i]);
+        }
+    } else {
+        const char *field = addrList;
+        for (int i = 0; i < count; i++) {
+            int length = strcspn(field, ",");
+            printf(i ? ", '%.*s'" : "'%.*s'", length, field);
+            field += length + 1;
+        }
+    }
+    printf("]\n");
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// rotation
+//
+// disk.py adds rotateSpeed to the angle each tick and resets it to 0.0 once
+// it reaches 360, so the angles repeat with a fixed period
+void initRotation() {
+    long capacity = (long) (360.0 / rotateSpeed) + 2;
+    angles = checkedMalloc(capacity * sizeof(double));
+    double angle = 0.0;
+    angles[0] = 0.0;
+    for (period = 1; ; period++) {
+        angle = angle + rotateSpeed;
+        if (angle >= 360.0) {
+            break;
+        }
+        if (period == capacity) {
+            capacity *= 2;
+            angles = realloc(angles, capacity * sizeof(double));
+            if (angles == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        angles[period] = angle;
+    }
+
+    matchStart = checkedMalloc(360 * sizeof(long));
+    matchCount = checkedMalloc(360 * sizeof(long));
+    for (int i = 0; i < 360; i++) {
+        matchStart[i] = -1;
+    }
+}
+
+double angleAt(long tick) {
+    return angles[tick % period];
+}
+
+// first tick from tick on where the head is within rotateSpeed of target,
+// as RadiallyCloseTo() checks it
+long firstMatch(long tick, int target) {
+    if (matchStart[target] == -1) {
+        matchStart[target] = matchesUsed;
+        for (long k = 0; k < period; k++) {
+            if (fabs(angles[k] - target) < rotateSpeed) {
+                if (matchesUsed == matchesCapacity) {
+                    matchesCapacity = matchesCapacity ? matchesCapacity * 2 : 1024;
+                    matches = realloc(matches, matchesCapacity * sizeof(long));
+                    if (matches == NULL) {
+                        perror("realloc");
+                        exit(1);
+                    }
+                }
+                matches[matchesUsed++] = k;
+            }
+        }
+        matchCount[target] = matchesUsed - matchStart[target];
+    }
+
+    long *list = matches + matchStart[target], count = matchCount[target];
+    if (count == 0) {
+        printf("the head never lines up with angle %d at rotation speed %s\n", target, rotateSpeedText);
+        exit(1);
+    }
+
+    long phase = tick % period, base = tick - phase;
+    long low = 0, high = count;
+    while (low < high) {
+        long mid = (low + high) / 2;
+        if (list[mid] < phase) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < count ? base + list[low] : base + period + list[0];
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// scheduling
+//
+void addQueueEntry(int block) {
+    if (block < 0 || block >= blockCount) {
+        printf("Block %d is not on the disk (0-%d)\n", block, blockCount - 1);
+        exit(1);
+    }
+    queueBlock[queueLength++] = block;
+}
+
+// add queue entries up to endIndex to the per-block lists
+void admit(int endIndex) {
+    for (; admitted < endIndex; admitted++) {
+        int block = queueBlock[admitted];
+        nextInBlock[admitted] = -1;
+        if (blockHead[block] == -1) {
+            blockHead[block] = admitted;
+        } else {
+            nextInBlock[blockTail[block]] = admitted;
+        }
+        blockTail[block] = admitted;
+        pendingOnTrack[blockTrack[block]]++;
+    }
+}
+
+// DoSATF()'s estimate of the time to reach and read block
+double estimate(int block) {
+    int track = blockTrack[block];
+    int angle = blockAngle[block];
+
+    int dist = abs(armTrack - track);
+    double seekEst = (TRACK_WIDTH / armSpeedBase) * dist;
+
+    int angleOffset = blockAngleOffset[track];
+    double angleAtArrival = angleAt(timer) + seekEst * rotateSpeed;
+    while (angleAtArrival > 360.0) {
+        angleAtArrival -= 360.0;
+    }
+    double rotDist = (angle - angleOffset) - angleAtArrival;
+    while (rotDist > 360.0) {
+        rotDist -= 360.0;
+    }
+    while (rotDist < 0.0) {
+        rotDist += 360.0;
+    }
+    double rotEst = rotDist / rotateSpeed;
+
+    double xferEst = (angleOffset * 2.0) / rotateSpeed;
+
+    return seekEst + rotEst + xferEst;
+}
+
+// pick the pending request in the window with the shortest estimated access
+// time, the earliest one on a tie. With sstf only blocks on the nearest
+// tracks count, as DoSSTF() narrows the list before DoSATF()
+int pickSATF(int endIndex, bool sstf) {
+    admit(endIndex);
+
+    int minDist = MAXTRACKS;
+    if (sstf) {
+        for (int track = 0; track < TRACKS; track++) {
+            if (pendingOnTrack[track] > 0 && abs(armTrack - track) < minDist) {
+                minDist = abs(armTrack - track);
+            }
+        }
+    }
+
+    int best = -1;
+    double bestEst = -1;
+    for (int block = 0; block < blockCount; block++) {
+        if (blockHead[block] == -1 || (sstf && abs(armTrack - blockTrack[block]) != minDist)) {
+            continue;
+        }
+        double est = estimate(block);
+        if (best == -1 || est < bestEst || (est == bestEst && blockHead[block] < blockHead[best])) {
+            best = block;
+            bestEst = est;
+        }
+    }
+    if (best == -1) {
+        printf("no request left in the scheduling window\n");
+        exit(1);
+    }
+
+    int index = blockHead[best];
+    blockHead[best] = nextInBlock[index];
+    pendingOnTrack[blockTrack[best]]--;
+    return index;
+}
+
+void updateWindow() {
+    if (fairWindow == -1 && currWindow > 0 && currWindow < queueLength) {
+        currWindow++;
+    }
+}
+
+// warning: doesn't just GET the window, but may update it as well
+long getWindow() {
+    if (currWindow <= -1) {
+        return queueLength;
+    }
+    if (fairWindow != -1 && requestCount > 0 && requestCount % fairWindow == 0) {
+        currWindow = currWindow + fairWindow;
+    }
+    return currWindow;
+}
+
+void printStats() {
+    if (compute) {
+        printf("\nTOTALS      Seek:%3ld  Rotate:%3ld  Transfer:%3ld  Total:%4ld\n\n", seekTotal, rotTotal, xferTotal, timer);
+    }
+}
+
+void planSeek(int track) {
+    seekBegin = timer;
+    state = STATE_SEEK;
+    if (track == armTrack) {
+        rotBegin = timer;
+        state = STATE_ROTATE;
+        return;
+    }
+    armTarget = track;
+    armTargetX1 = spindleX - tracks[track] - (TRACK_WIDTH / 2.0);
+    armSpeed = track >= armTrack ? armSpeedBase : -armSpeedBase;
+}
+
+void getNextIO() {
+    if (requestCount == queueLength) {
+        printStats();
+        isDone = true;
+        return;
+    }
+
+    if (policy == FIFO) {
+        currentIndex = requestCount;
+    } else if (policy == SATF || policy == BSATF) {
+        long endIndex = getWindow();
+        if (endIndex > queueLength) {
+            endIndex = queueLength;
+        }
+        currentIndex = pickSATF(endIndex, false);
+    } else {
+        long endIndex = getWindow();
+        if (endIndex > queueLength) {
+            endIndex = queueLength;
+        }
+        currentIndex = pickSATF(endIndex, true);
+    }
+    currentBlock = queueBlock[currentIndex];
+
+    planSeek(blockTrack[currentBlock]);
+
+    if (lateCount < lateTotal) {
+        addQueueEntry(lateRequests[lateCount++]);
+    }
+}
+
+void doRequestStats() {
+    long seekTime = rotBegin - seekBegin;
+    long rotTime = xferBegin - rotBegin;
+    long xferTime = timer - xferBegin;
+    long totalTime = timer - seekBegin;
+
+    if (compute) {
+        printf("Block: %3d  Seek:%3ld  Rotate:%3ld  Transfer:%3ld  Total:%4ld\n", currentBlock, seekTime, rotTime, xferTime, totalTime);
+    }
+
+    seekTotal += seekTime;
+    rotTotal += rotTime;
+    xferTotal += xferTime;
+}
+
+// carry the current request through seek, rotation and transfer, the same
+// ticks Animate() would step through, then pick the next one
+void serveRequest() {
+    int angleOffset;
+    long checkFrom;
+
+    if (state == STATE_SEEK) {
+        do {
+            timer++;
+            armX1 += armSpeed;
+        } while (!((armSpeed > 0.0 && armX1 >= armTargetX1) || (armSpeed < 0.0 && armX1 <= armTargetX1)));
+        armTrack = armTarget;
+        rotBegin = timer;
+        state = STATE_ROTATE;
+        checkFrom = timer; // the rotation check runs in the tick the seek ends
+    } else {
+        checkFrom = timer + 1;
+    }
+
+    angleOffset = blockAngleOffset[armTrack];
+    if (state == STATE_ROTATE) {
+        timer = firstMatch(checkFrom, pyMod(blockAngle[currentBlock] - angleOffset, 360));
+        xferBegin = timer;
+        state = STATE_XFER;
+        checkFrom = timer;
+    }
+    timer = firstMatch(checkFrom, pyMod(blockAngle[currentBlock] + angleOffset, 360));
+
+    requestCount++;
+    doRequestStats();
+    state = STATE_DONE;
+    updateWindow();
+
+    int previousBlock = currentBlock;
+    getNextIO();
+    int nextBlock = currentBlock;
+    if (blockTrack[previousBlock] == blockTrack[nextBlock]) {
+        if ((previousBlock == trackEnd[armTrack] && nextBlock == trackBegin[armTrack]) || previousBlock + 1 == nextBlock) {
+            // the next block follows right on: stay in transfer mode
+            rotBegin = seekBegin = xferBegin = timer;
+            state = STATE_XFER;
+        }
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// main
+//
+// the value of option shortName/longName at argv[*i], NULL if it is another option
+char *optionValue(int argc, char *argv[], int *i, const char *shortName, const char *longName) {
+    char *arg = argv[*i];
+    size_t longLength = strlen(longName);
+    if (strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0) {
+        if (*i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        return argv[++*i];
+    }
+    if (strncmp(arg, shortName, 2) == 0 && arg[2] != '\0') {
+        return arg + 2;
+    }
+    if (strncmp(arg, longName, longLength) == 0 && arg[longLength] == '=') {
+        return arg + longLength + 1;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        char *value;
+        if ((value = optionValue(argc, argv, &i, "-s", "--seed")) != NULL) {
+            seed = strtoll(value, NULL, 10);
+        } else if ((value = optionValue(argc, argv, &i, "-a", "--addr")) != NULL) {
+            addr = value;
+        } else if ((value = optionValue(argc, argv, &i, "-A", "--addrDesc")) != NULL) {
+            addrDesc = value;
+        } else if ((value = optionValue(argc, argv, &i, "-S", "--seekSpeed")) != NULL) {
+            seekSpeedText = value;
+        } else if ((value = optionValue(argc, argv, &i, "-R", "--rotSpeed")) != NULL) {
+            rotateSpeedText = value;
+        } else if ((value = optionValue(argc, argv, &i, "-p", "--policy")) != NULL) {
+            policyName = value;
+        } else if ((value = optionValue(argc, argv, &i, "-w", "--schedWindow")) != NULL) {
+            window = parseLong(value);
+        } else if ((value = optionValue(argc, argv, &i, "-o", "--skewOffset")) != NULL) {
+            skew = parseLong(value);
+        } else if ((value = optionValue(argc, argv, &i, "-z", "--zoning")) != NULL) {
+            zoning = value;
+        } else if ((value = optionValue(argc, argv, &i, "-l", "--lateAddr")) != NULL) {
+            lateAddr = value;
+        } else if ((value = optionValue(argc, argv, &i, "-L", "--lateAddrDesc")) != NULL) {
+            lateAddrDesc = value;
+        } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--compute") == 0) {
+            compute = true;
+        } else if (strcmp(argv[i], "-G") == 0 || strcmp(argv[i], "--graphics") == 0) {
+            graphics = true;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    printf("OPTIONS seed %lld\n", seed);
+    printf("OPTIONS addr %s\n", addr);
+    printf("OPTIONS addrDesc %s\n", addrDesc);
+    printf("OPTIONS seekSpeed %s\n", seekSpeedText);
+    printf("OPTIONS rotateSpeed %s\n", rotateSpeedText);
+    printf("OPTIONS skew %ld\n", skew);
+    printf("OPTIONS window %ld\n", window);
+    printf("OPTIONS policy %s\n", policyName);
+    printf("OPTIONS compute %s\n", compute ? "True" : "False");
+    printf("OPTIONS graphics %s\n", graphics ? "True" : "False");
+    printf("OPTIONS zoning %s\n", zoning);
+    printf("OPTIONS lateAddr %s\n", lateAddr);
+    printf("OPTIONS lateAddrDesc %s\n", lateAddrDesc);
+    printf("\n");
+
+    if (window == 0) {
+        printf("Scheduling window (%ld) must be positive or -1 (which means a full window)\n", window);
+        exit(1);
+    }
+    if (graphics) {
+        printf("Graphics are not supported here; use disk.py -G\n");
+        exit(1);
+    }
+
+    seekSpeed = parseDouble(seekSpeedText);
+    rotateSpeed = parseDouble(rotateSpeedText);
+    if (strcmp(policyName, "FIFO") == 0) {
+        policy = FIFO;
+    } else if (strcmp(policyName, "SSTF") == 0) {
+        policy = SSTF;
+    } else if (strcmp(policyName, "SATF") == 0) {
+        policy = SATF;
+    } else if (strcmp(policyName, "BSATF") == 0) {
+        policy = BSATF;
+    } else {
+        policy = -1; // reported when the first request is scheduled, as disk.py does
+    }
+
+    // figure out zones first, to figure out the max possible request
+    initBlockLayout();
+
+    randomSeed(seed);
+    requestTotal = makeRequests(addr, addrDesc, &requests);
+    lateTotal = makeRequests(lateAddr, lateAddrDesc, &lateRequests);
+
+    // fairness stuff
+    fairWindow = (policy == BSATF && window != -1) ? window : -1;
+
+    printRequests("REQUESTS", addr, requests, requestTotal);
+    printf("\n");
+    if (lateTotal > 0) {
+        printRequests("LATE REQUESTS", lateAddr, lateRequests, lateTotal);
+        printf("\n");
+    }
+
+    if (!compute) {
+        printf("\n");
+        printf("For the requests above, compute the seek, rotate, and transfer times.\n");
+        printf("Use -c or the graphical mode (-G) to see the answers.\n");
+        printf("\n");
+    }
+
+    if (seekSpeed > 1 && fmod(TRACK_WIDTH, seekSpeed) != 0) {
+        printf("Seek speed (%d) must divide evenly into track width (%d)\n", (int) seekSpeed, TRACK_WIDTH);
+        exit(1);
+    }
+    if (seekSpeed < 1) {
+        double x = TRACK_WIDTH / seekSpeed;
+        double y = (int) ((double) TRACK_WIDTH / seekSpeed);
+        if (seekSpeed <= 0 || x != y) {
+            printf("Seek speed (%f) must divide evenly into track width (%d)\n", seekSpeed, TRACK_WIDTH);
+            exit(1);
+        }
+    }
+    if (rotateSpeed <= 0) {
+        printf("Rotation speed (%f) must be positive\n", rotateSpeed);
+        exit(1);
+    }
+
+    // disk arm, starting over the outer track
+    spindleX = WIDTH / 2.0;
+    double armX = spindleX - (tracks[0] * cos(0.0));
+    armX1 = armX - 20;
+    armSpeedBase = armSpeed = seekSpeed;
+
+    initRotation();
+
+    queueLength = 0;
+    queueBlock = checkedMalloc((requestTotal + lateTotal) * sizeof(int));
+    nextInBlock = checkedMalloc((requestTotal + lateTotal) * sizeof(int));
+    blockHead = checkedMalloc(blockCount * sizeof(int));
+    blockTail = checkedMalloc(blockCount * sizeof(int));
+    for (int i = 0; i < blockCount; i++) {
+        blockHead[i] = -1;
+    }
+    for (int i = 0; i < requestTotal; i++) {
+        addQueueEntry(requests[i]);
+    }
+
+    // scheduling window
+    currWindow = window;
+
+    if (policy == -1 && queueLength > 0) {
+        printf("policy (%s) not implemented\n", policyName);
+        exit(1);
+    }
+
+    getNextIO();
+    while (!isDone) {
+        serveRequest();
+    }
+    return 0;
+}
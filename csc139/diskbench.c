@@ -0,0 +1,624 @@
+// Storage benchmark in the style of CrystalDiskMark, for the disks lab on Linux.
+//
+// build: gcc -O2 -o diskbench diskbench.c -lpthread
+//
+// Runs the CrystalDiskMark profiles (SEQ1M Q8T1, SEQ1M Q1T1, RND4K Q32T1,
+// RND4K Q1T1), or one profile given with -r/-b/-q/-t, against a test file
+// opened with O_DIRECT so the page cache is out of the way. Each profile is
+// read and then written for a fixed time, and reported as MB/s, IOPS and
+// latency percentiles.
+//
+// I/O goes through io_uring when the kernel allows it: each thread keeps its
+// own ring full to the queue depth. io_uring is used through its system
+// calls and <linux/io_uring.h>, so liburing isn't needed. Otherwise each
+// thread becomes queue depth pread/pwrite threads, which keeps the same
+// number of requests in flight.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define ALIGNMENT 4096 // O_DIRECT buffers, offsets and sizes are multiples of this
+#define FILL_BLOCK (1 << 20) // bytes written at a time when creating the test file
+#define HIST_SUB_BITS 5 // latency histogram: 32 buckets per power of two, within 3%
+#define HIST_BUCKETS 2048
+#define MAX_WORKERS 1024
+
+typedef struct {
+    const char *name;
+    bool random;
+    size_t blockSize;
+    int depth; // requests in flight per thread
+    int threads;
+} Profile;
+
+static const Profile gProfiles[] = {
+    { "SEQ1M Q8T1", false, 1 << 20, 8, 1 },
+    { "SEQ1M Q1T1", false, 1 << 20, 1, 1 },
+    { "RND4K Q32T1", true, 4096, 32, 1 },
+    { "RND4K Q1T1", true, 4096, 1, 1 },
+};
+
+// the part of the file one thread works on
+typedef struct {
+    off_t start;
+    long blocks;
+    atomic_long cursor; // next block for sequential access, shared by a pread group
+} Stream;
+
+// one thread issuing I/O and what it measured
+typedef struct {
+    pthread_t thread;
+    Stream *stream;
+    const Profile *profile;
+    bool write;
+    uint64_t rng;
+    long ios;
+    long errors;
+    long maxLatency;
+    long hist[HIST_BUCKETS]; // latencies in ns
+} Worker;
+
+// an io_uring instance and its mapped rings
+typedef struct {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+} Ring;
+
+static const char *gPath = "diskbench.tmp";
+static long gFileSize = 1024L << 20;
+static int gSeconds = 5;
+static bool gDirect = true;
+static bool gUseUring = true;
+static bool gDoRead = true, gDoWrite = true;
+static int gFd = -1;
+static volatile sig_atomic_t gCreated; // the test file is ours to remove
+static atomic_bool gStop;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// helpers
+//
+static long NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static uint64_t NextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void *AlignedBuffer(size_t size, uint64_t *rng) {
+    void *buffer;
+    if (posix_memalign(&buffer, ALIGNMENT, size) != 0) {
+        fprintf(stderr, "diskbench: out of memory\n");
+        exit(1);
+    }
+    // random contents, so a drive that compresses or dedups can't cheat
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+        ((uint64_t *) buffer)[i] = NextRandom(rng);
+    }
+    return buffer;
+}
+
+// sizes like 4096, 4k, 1m, 2g
+static long ParseSize(const char *text) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    }
+    return *end == '\0' ? value : -1;
+}
+
+static int HistBucket(long ns) {
+    if (ns < (2 << HIST_SUB_BITS)) {
+        return ns < 0 ? 0 : ns;
+    }
+    int shift = 63 - __builtin_clzl(ns) - HIST_SUB_BITS;
+    int bucket = (shift << HIST_SUB_BITS) + (ns >> shift);
+    return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+// middle of the range of latencies a bucket counts
+static double HistValue(int bucket) {
+    if (bucket < (2 << HIST_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    long low = (long) (bucket - (shift << HIST_SUB_BITS)) << shift;
+    return low + (1L << shift) / 2.0;
+}
+
+static double Percentile(long *hist, long total, double fraction) {
+    long want = (long) (total * fraction), seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > want) {
+            return HistValue(b);
+        }
+    }
+    return 0;
+}
+
+static off_t NextOffset(Worker *worker) {
+    Stream *stream = worker->stream;
+    long block;
+    if (worker->profile->random) {
+        block = NextRandom(&worker->rng) % stream->blocks;
+    } else {
+        block = atomic_fetch_add_explicit(&stream->cursor, 1, memory_order_relaxed) % stream->blocks;
+    }
+    return stream->start + (off_t) block * worker->profile->blockSize;
+}
+
+static void Record(Worker *worker, long latency, ssize_t result) {
+    if (result != (ssize_t) worker->profile->blockSize) {
+        if (worker->errors++ == 0) {
+            fprintf(stderr, "diskbench: %s failed: %s\n", worker->write ? "write" : "read",
+                    result < 0 ? strerror(-result) : "short transfer");
+        }
+        atomic_store(&gStop, true);
+        return;
+    }
+    worker->ios++;
+    worker->hist[HistBucket(latency)]++;
+    if (latency > worker->maxLatency) {
+        worker->maxLatency = latency;
+    }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// io_uring
+//
+static int RingInit(Ring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            munmap(ring->sqRing, ring->sqRingSize);
+            close(ring->fd);
+            return -1;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cqRing != ring->sqRing) {
+            munmap(ring->cqRing, ring->cqRingSize);
+        }
+        munmap(ring->sqRing, ring->sqRingSize);
+        close(ring->fd);
+        return -1;
+    }
+
+    char *sq = ring->sqRing, *cq = ring->cqRing;
+    ring->sqHead = (unsigned *) (sq + params.sq_off.head);
+    ring->sqTail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *) (sq + params.sq_off.array);
+    ring->cqHead = (unsigned *) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void RingDestroy(Ring *ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+}
+
+// queue one read or write; the caller never has more in flight than the ring holds
+static void RingQueue(Ring *ring, bool write, void *buffer, unsigned length, off_t offset, uint64_t userData) {
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = gFd;
+    sqe->addr = (uintptr_t) buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int RingEnter(Ring *ring, unsigned submit, unsigned wait) {
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static bool UringAvailable(const char **reason) {
+    Ring ring;
+    if (RingInit(&ring, 1) != 0) {
+        *reason = errno == ENOSYS ? "the kernel has no io_uring"
+                : errno == EPERM ? "io_uring is disabled, see /proc/sys/kernel/io_uring_disabled"
+                : strerror(errno);
+        return false;
+    }
+    RingDestroy(&ring);
+    return true;
+}
+
+// keep depth requests in flight on this thread's ring until told to stop
+static void *UringWorker(void *arg) {
+    Worker *worker = arg;
+    int depth = worker->profile->depth;
+    size_t blockSize = worker->profile->blockSize;
+    Ring ring;
+
+    if (RingInit(&ring, depth) != 0) {
+        fprintf(stderr, "diskbench: io_uring_setup: %s\n", strerror(errno));
+        worker->errors++;
+        atomic_store(&gStop, true);
+        return NULL;
+    }
+
+    void **buffers = malloc(depth * sizeof(void *));
+    long *started = malloc(depth * sizeof(long));
+    for (int slot = 0; slot < depth; slot++) {
+        buffers[slot] = AlignedBuffer(blockSize, &worker->rng);
+        started[slot] = NowNs();
+        RingQueue(&ring, worker->write, buffers[slot], blockSize, NextOffset(worker), slot);
+    }
+
+    unsigned toSubmit = depth, inFlight = depth;
+    while (inFlight > 0) {
+        if (RingEnter(&ring, toSubmit, 1) < 0) {
+            fprintf(stderr, "diskbench: io_uring_enter: %s\n", strerror(errno));
+            worker->errors++;
+            atomic_store(&gStop, true);
+            break;
+        }
+        toSubmit = 0;
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        long now = NowNs();
+        bool stop = atomic_load_explicit(&gStop, memory_order_relaxed);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+            int slot = cqe->user_data;
+            Record(worker, now - started[slot], cqe->res);
+            inFlight--;
+            if (!stop) {
+                started[slot] = now;
+                RingQueue(&ring, worker->write, buffers[slot], blockSize, NextOffset(worker), slot);
+                toSubmit++;
+                inFlight++;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    for (int slot = 0; slot < depth; slot++) {
+        free(buffers[slot]);
+    }
+    free(buffers);
+    free(started);
+    RingDestroy(&ring);
+    return NULL;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// pread/pwrite fallback: one request in flight per worker
+//
+static void *SyncWorker(void *arg) {
+    Worker *worker = arg;
+    size_t blockSize = worker->profile->blockSize;
+    void *buffer = AlignedBuffer(blockSize, &worker->rng);
+
+    while (!atomic_load_explicit(&gStop, memory_order_relaxed)) {
+        off_t offset = NextOffset(worker);
+        long start = NowNs();
+        ssize_t done = worker->write ? pwrite(gFd, buffer, blockSize, offset)
+                                     : pread(gFd, buffer, blockSize, offset);
+        Record(worker, NowNs() - start, done < 0 ? -errno : done);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// running the tests
+//
+static void RunTest(const Profile *profile, bool write) {
+    int threads = profile->threads;
+    int perThread = gUseUring ? 1 : profile->depth;
+    int workerCount = threads * perThread;
+    Stream *streams = calloc(threads, sizeof(Stream));
+    Worker *workers = calloc(workerCount, sizeof(Worker));
+
+    // each thread gets an equal, block-aligned share of the file
+    long blocks = gFileSize / profile->blockSize / threads;
+    for (int t = 0; t < threads; t++) {
+        streams[t].start = (off_t) t * blocks * profile->blockSize;
+        streams[t].blocks = blocks;
+    }
+
+    atomic_store(&gStop, false);
+    long start = NowNs();
+    for (int w = 0; w < workerCount; w++) {
+        workers[w].stream = &streams[w / perThread];
+        workers[w].profile = profile;
+        workers[w].write = write;
+        workers[w].rng = 0x9E3779B97F4A7C15ULL * (w + 1) ^ start;
+        pthread_create(&workers[w].thread, NULL, gUseUring ? UringWorker : SyncWorker, &workers[w]);
+    }
+
+    struct timespec duration = { gSeconds, 0 };
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR) {
+    }
+    atomic_store(&gStop, true);
+
+    long ios = 0, errors = 0, maxLatency = 0;
+    static long hist[HIST_BUCKETS];
+    memset(hist, 0, sizeof(hist));
+    for (int w = 0; w < workerCount; w++) {
+        pthread_join(workers[w].thread, NULL);
+        ios += workers[w].ios;
+        errors += workers[w].errors;
+        if (workers[w].maxLatency > maxLatency) {
+            maxLatency = workers[w].maxLatency;
+        }
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            hist[b] += workers[w].hist[b];
+        }
+    }
+    double elapsed = (NowNs() - start) / 1e9;
+
+    if (write) {
+        fdatasync(gFd); // so a write test's dirty data doesn't slow the next one
+    }
+
+    printf("%-14s %-5s %10.2f %11.1f", profile->name, write ? "write" : "read",
+           ios * (double) profile->blockSize / elapsed / 1e6, ios / elapsed);
+    if (ios > 0) {
+        printf(" %10.1f %10.1f %10.1f %10.1f", Percentile(hist, ios, 0.50) / 1e3,
+               Percentile(hist, ios, 0.99) / 1e3, Percentile(hist, ios, 0.999) / 1e3,
+               maxLatency / 1e3);
+    }
+    printf(errors ? "  (%ld errors)\n" : "\n", errors);
+    fflush(stdout);
+
+    free(workers);
+    free(streams);
+}
+
+// Ctrl-C or kill: don't leave a test file of up to a GiB behind
+static void RemoveTestFile(int sig) {
+    if (gCreated) {
+        unlink(gPath);
+    }
+    _exit(128 + sig);
+}
+
+// create the test file and fill it with random data, so reads hit real blocks
+static void CreateTestFile(void) {
+    struct sigaction action = { .sa_handler = RemoveTestFile };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    gFd = open(gPath, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (gFd < 0) {
+        if (errno == EEXIST) {
+            fprintf(stderr, "diskbench: %s exists; remove it or pick another path with -f\n", gPath);
+        } else {
+            perror(gPath);
+        }
+        exit(1);
+    }
+    gCreated = 1;
+
+    // O_DIRECT is switched on once the file exists, so a filesystem without it
+    // (tmpfs, for one) can't leave a half-created file behind a failed open
+    if (gDirect && fcntl(gFd, F_SETFL, fcntl(gFd, F_GETFL) | O_DIRECT) != 0) {
+        fprintf(stderr, "diskbench: %s: no O_DIRECT on this filesystem, results include the page cache\n", gPath);
+        gDirect = false;
+    }
+
+    uint64_t rng = 1;
+    void *buffer = AlignedBuffer(FILL_BLOCK, &rng);
+    for (long done = 0; done < gFileSize; done += FILL_BLOCK) {
+        if (pwrite(gFd, buffer, FILL_BLOCK, done) != FILL_BLOCK) {
+            perror(gPath);
+            unlink(gPath);
+            exit(1);
+        }
+    }
+    free(buffer);
+    fdatasync(gFd);
+}
+
+static void Usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [-f file] [-s size] [-d seconds] [-m read|write|both] [-e uring|sync] [-B]\n"
+            "          [-r seq|rand] [-b blockSize] [-q queueDepth] [-t threads]\n"
+            "  runs the CrystalDiskMark profiles, or the one -r/-b/-q/-t describe\n"
+            "  -f  test file to create, and remove afterwards (diskbench.tmp)\n"
+            "  -s  test file size (1g)\n"
+            "  -d  seconds per test (5)\n"
+            "  -B  buffered I/O instead of O_DIRECT\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    Profile custom = { NULL, true, 4096, 1, 1 };
+    bool useCustom = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-B") == 0) {
+            gDirect = false;
+            continue;
+        }
+        if (value == NULL) {
+            Usage(argv[0]);
+        }
+        i++;
+        if (strcmp(argv[i - 1], "-f") == 0) {
+            gPath = value;
+        } else if (strcmp(argv[i - 1], "-s") == 0) {
+            gFileSize = ParseSize(value);
+        } else if (strcmp(argv[i - 1], "-d") == 0) {
+            gSeconds = atoi(value);
+        } else if (strcmp(argv[i - 1], "-m") == 0) {
+            if (strcmp(value, "read") != 0 && strcmp(value, "write") != 0 && strcmp(value, "both") != 0) {
+                fprintf(stderr, "diskbench: -m must be read, write or both, not '%s'\n", value);
+                Usage(argv[0]);
+            }
+            gDoRead = strcmp(value, "write") != 0;
+            gDoWrite = strcmp(value, "read") != 0;
+        } else if (strcmp(argv[i - 1], "-e") == 0) {
+            if (strcmp(value, "uring") != 0 && strcmp(value, "sync") != 0) {
+                fprintf(stderr, "diskbench: -e must be uring or sync, not '%s'\n", value);
+                Usage(argv[0]);
+            }
+            gUseUring = strcmp(value, "sync") != 0;
+        } else if (strcmp(argv[i - 1], "-r") == 0) {
+            if (strcmp(value, "seq") != 0 && strcmp(value, "rand") != 0) {
+                fprintf(stderr, "diskbench: -r must be seq or rand, not '%s'\n", value);
+                Usage(argv[0]);
+            }
+            custom.random = strcmp(value, "rand") == 0;
+            useCustom = true;
+        } else if (strcmp(argv[i - 1], "-b") == 0) {
+            custom.blockSize = ParseSize(value);
+            useCustom = true;
+        } else if (strcmp(argv[i - 1], "-q") == 0) {
+            custom.depth = atoi(value);
+            useCustom = true;
+        } else if (strcmp(argv[i - 1], "-t") == 0) {
+            custom.threads = atoi(value);
+            useCustom = true;
+        } else {
+            Usage(argv[0]);
+        }
+    }
+
+    if (gSeconds <= 0 || custom.depth <= 0 || custom.threads <= 0 ||
+        custom.depth * custom.threads > MAX_WORKERS) {
+        fprintf(stderr, "diskbench: seconds, queue depth and threads must be positive, with at most %d requests in flight\n",
+                MAX_WORKERS);
+        return 1;
+    }
+    if ((long) custom.blockSize <= 0 || custom.blockSize % ALIGNMENT != 0) {
+        fprintf(stderr, "diskbench: block size must be a multiple of %d\n", ALIGNMENT);
+        return 1;
+    }
+    if (gFileSize <= 0) {
+        fprintf(stderr, "diskbench: bad file size\n");
+        return 1;
+    }
+    gFileSize = (gFileSize + FILL_BLOCK - 1) / FILL_BLOCK * FILL_BLOCK;
+
+    static char customName[64];
+    const Profile *profiles = gProfiles;
+    int profileCount = sizeof(gProfiles) / sizeof(gProfiles[0]);
+    if (useCustom) {
+        if (custom.blockSize % (1 << 20) == 0) {
+            snprintf(customName, sizeof(customName), "%s%zuM Q%dT%d", custom.random ? "RND" : "SEQ",
+                     custom.blockSize >> 20, custom.depth, custom.threads);
+        } else {
+            snprintf(customName, sizeof(customName), "%s%zuK Q%dT%d", custom.random ? "RND" : "SEQ",
+                     custom.blockSize >> 10, custom.depth, custom.threads);
+        }
+        custom.name = customName;
+        profiles = &custom;
+        profileCount = 1;
+    }
+    for (int p = 0; p < profileCount; p++) {
+        if (gFileSize / (long) profiles[p].blockSize < profiles[p].threads) {
+            fprintf(stderr, "diskbench: the test file is too small for %s\n", profiles[p].name);
+            return 1;
+        }
+    }
+
+    const char *reason;
+    if (gUseUring && !UringAvailable(&reason)) {
+        fprintf(stderr, "diskbench: io_uring unavailable (%s), using pread/pwrite threads\n", reason);
+        gUseUring = false;
+    }
+
+    CreateTestFile();
+    printf("%s: %ld MiB, %s, %s, %d s per test\n", gPath, gFileSize >> 20,
+           gDirect ? "O_DIRECT" : "buffered", gUseUring ? "io_uring" : "pread/pwrite threads", gSeconds);
+    printf("%-14s %-5s %10s %11s %10s %10s %10s %10s\n", "test", "mode", "MB/s", "IOPS",
+           "p50 us", "p99 us", "p99.9 us", "max us");
+
+    for (int p = 0; p < profileCount; p++) {
+        if (gDoRead) {
+            RunTest(&profiles[p], false);
+        }
+        if (gDoWrite) {
+            RunTest(&profiles[p], true);
+        }
+    }
+
+    close(gFd);
+    unlink(gPath);
+    return 0;
+}
@@ -334,3 +334,61 @@ void umemstats(void) {
 
     printumemstats(total_allocations, total_deallocations, total_allocated, free_memory, fragmentation);
 }
+
+// take one arena chunk of at least size data bytes from umalloc
+static uarena_chunk_t *new_arena_chunk(size_t size, uarena_chunk_t *next) {
+    uarena_chunk_t *chunk = umalloc(sizeof(uarena_chunk_t) + size);
+    if (!chunk) return NULL;
+
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+// set up an arena whose chunks hold chunkSize bytes; umeminit must come first
+int uarenainit(uarena_t *arena, size_t chunkSize) {
+    arena->chunkSize = (chunkSize + (8 - 1)) & ~(8 - 1);
+    arena->head = new_arena_chunk(arena->chunkSize, NULL);
+    return arena->head ? 0 : -1;
+}
+
+// bump-allocate size bytes, 8-byte aligned. A request that doesn't fit in
+// what is left starts a new chunk, sized for it if it is bigger than usual
+void *uarenaalloc(uarena_t *arena, size_t size) {
+    size = (size + (8 - 1)) & ~(8 - 1);
+
+    uarena_chunk_t *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = new_arena_chunk(size > arena->chunkSize ? size : arena->chunkSize, arena->head);
+        if (!chunk) return NULL;
+        arena->head = chunk;
+    }
+
+    void *ptr = (char *)chunk + sizeof(uarena_chunk_t) + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+// release everything allocated from the arena. In the usual case of one
+// chunk this only rewinds it; chunks added for overflow go back to ufree
+void uarenareset(uarena_t *arena) {
+    uarena_chunk_t *chunk = arena->head;
+    if (!chunk) return;
+
+    while (chunk->next) {
+        uarena_chunk_t *older = chunk->next;
+        ufree(chunk);
+        chunk = older;
+    }
+
+    // the oldest chunk is the normal-sized one from uarenainit
+    chunk->used = 0;
+    arena->head = chunk;
+}
+
+void uarenadestroy(uarena_t *arena) {
+    uarenareset(arena);
+    ufree(arena->head);
+    arena->head = NULL;
+}
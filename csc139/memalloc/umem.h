@@ -26,6 +26,19 @@ typedef struct __node_t {
     struct __node_t *next;  // Pointer to the next free block
 } node_t;
 
+// Arena: a bump allocator on chunks taken from umalloc. Everything allocated
+// from it is released at once by uarenareset, which keeps the first chunk
+typedef struct __uarena_chunk_t {
+    struct __uarena_chunk_t *next;  // older, full chunk
+    size_t size;                    // bytes of data after this header
+    size_t used;                    // bytes handed out so far
+} uarena_chunk_t;
+
+typedef struct {
+    uarena_chunk_t *head;           // chunk being allocated from
+    size_t chunkSize;               // data bytes in a normal chunk
+} uarena_t;
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // function prototypes
 //
@@ -35,6 +48,11 @@ void    *urealloc(void *ptr, size_t size);
 int 	ufree(void *ptr);
 void    umemstats(void);
 
+int     uarenainit(uarena_t *arena, size_t chunkSize);
+void    *uarenaalloc(uarena_t *arena, size_t size);
+void    uarenareset(uarena_t *arena);
+void    uarenadestroy(uarena_t *arena);
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 /**
  * Macro: printumemstats
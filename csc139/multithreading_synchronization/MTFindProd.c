@@ -51,92 +51,478 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <sys/timeb.h>
 #include <semaphore.h>
 #include <stdbool.h> // For bool, true, false
+#include <string.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "preduce.h"
+#include "perfcount.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // AVX2/AVX-512 intrinsics for the vectorized product kernels
+#define HAVE_X86_KERNELS 1
+#endif
 
 #define MAX_SIZE 100000000
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024) //Alignment that lets transparent huge pages back the data buffer
 #define MAX_THREADS 16
 #define RANDOM_SEED 7649
 #define MAX_RANDOM_NUMBER 3000
 #define NUM_LIMIT 9973
 
+#define GEN_SPLITMIX 0 //Counter-based generator: element i depends only on i, so any thread can produce any range
+#define GEN_LEGACY 1 //The original srand/rand sequence, generated serially
+#define SPLITMIX_GAMMA 0x9E3779B97F4A7C15ULL
+#define DATASET_MAGIC "MTFPDATA"
+
+#define STREAM_BUFFERS 3 //Buffers in the streaming ring: one being reduced, one being read, one spare
+#define STREAM_CHUNK (4 * 1024 * 1024) //Default elements per streaming buffer (16 MiB)
+#define BENCH_USAGE "MTFindProd -bench [-sizes n,n,...] [-threads t,t,...] [-modes m,m,...] [-warmup n] [-trials n]\n" \
+                    "                  [-zero index] [-format csv|json] [-k kernel] [-s static|dynamic]\n" \
+                    "                  [-e auto|multiply|histogram] [-g splitmix|legacy]\n"
+#define STREAM_POLL_MS 100 //How long the reader blocks on its input before checking gStreamStop again
+
+// Barrett reduction constants for the vectorized kernels: x mod NUM_LIMIT = x - q * NUM_LIMIT
+// with q = (x * BARRETT_FACTOR) >> BARRETT_SHIFT, which is off by at most one for any 32-bit x
+#define BARRETT_SHIFT 39
+#define BARRETT_FACTOR ((1ULL << BARRETT_SHIFT) / NUM_LIMIT)
+#define KERNEL_BLOCK 4096 //Elements multiplied between checks for a zero lane
+#define CANCEL_CHUNK 65536 //Elements a worker multiplies between checks of gCancelled
+
+// Histogram engine: every generated value lies in [0, MAX_RANDOM_NUMBER], so the product is the
+// product of v^count(v) over that domain, a histogram pass plus at most HIST_DOMAIN exponentiations
+#define HIST_DOMAIN (MAX_RANDOM_NUMBER + 1) //Values counted directly; any other value falls back to multiplication
+#define HIST_LANES 4 //Sub-histograms per thread, so runs of equal values don't serialize on one counter
+#define HIST_MIN_ELEMENTS (16 * HIST_DOMAIN) //Per-thread elements below which "auto" keeps multiplying
+#define ENGINE_AUTO 0 //Histogram when every value is in the domain and it is small next to each thread's division
+#define ENGINE_MULTIPLY 1
+#define ENGINE_HISTOGRAM 2
+#define MAX_SHARDS 64 //Worker processes in sharded mode; each still runs up to MAX_THREADS threads
+
+typedef int (*ProdKernel)(const int* data, int count); //Computes the product of data[0..count-1] mod NUM_LIMIT
+
+// Everything one worker thread reports back, padded to a full cache line
+typedef struct {
+    int prod; //The modular product for the array division this thread is responsible for
+    volatile bool done; //Is this thread done? Used when the parent is continually checking on child threads
+    long wasted; //Elements multiplied in chunks that finished after gCancelled was raised
+    long scanned; //Elements this thread read, for bytes/cycle
+    PerfSample perf; //Hardware counters for this thread's share of the phase, with -perf
+} __attribute__((aligned(CACHE_LINE_SIZE))) ThreadResult;
+
+// Header of a dataset file written with -save; the elements follow it, still cache-line aligned
+typedef struct {
+    char magic[8]; //DATASET_MAGIC
+    long count; //Number of elements in the file
+    int generator; //GEN_SPLITMIX or GEN_LEGACY
+    int seed; //RANDOM_SEED the file was generated with
+    char padding[CACHE_LINE_SIZE - 24];
+} DatasetHeader;
+
+// One slot of the streaming ring, handed between the reader thread and the reducing parent
+typedef struct {
+    int* data;
+    long count; //Elements in the buffer; 0 with eof set marks the end of the input
+    bool full; //Filled by the reader and not yet reduced
+    bool eof;
+} StreamBuffer;
+
+// One thread's value counts, split into HIST_LANES interleaved sub-histograms
+typedef struct {
+    unsigned int count[HIST_LANES][HIST_DOMAIN];
+    bool outOfDomain; //Saw a value outside [0, MAX_RANDOM_NUMBER]
+} __attribute__((aligned(CACHE_LINE_SIZE))) ValueHistogram;
+
+// What a shard process writes back to the parent through its pipe
+typedef struct {
+    int shard;
+    int prod; //Product of the shard mod NUM_LIMIT
+    long ns; //Time the shard took, from fork to result
+} ShardResult;
+
+typedef int (*PhaseFunc)(int arraySize, int indices[MAX_THREADS][3]); //Runs one reduction and returns the product
+
+// One way of computing the product: a short name for benchmark output and the label of its timing line
+typedef struct {
+    const char* name;
+    const char* label;
+    PhaseFunc run;
+} Phase;
+
 // Global variables
 long gRefTime; //For timing
-int gData[MAX_SIZE]; //The array that will hold the data
+long gResultNs; //When the current phase's parent had its product (CLOCK_MONOTONIC ns)
+double gResultCpuMs; //Parent CPU time at that point
+long gDrainNs; //Time spent joining children after the result, -1 for phases that only have the result after joining
+int* gData; //The array that will hold the data: exactly arraySize elements from AllocateData, or a dataset file mapped with -load
+int gGenerator = GEN_SPLITMIX; //Which generator GenerateInput uses
 
 int gThreadCount; //Number of threads
 int gDoneThreadCount; //Number of threads that are done at a certain point. Whenever a thread is done, it increments this. Used with the semaphore-based solution
-int gThreadProd[MAX_THREADS]; //The modular product for each array division that a single thread is responsible for
-volatile bool gThreadDone[MAX_THREADS]; //Is this thread done? Used when the parent is continually checking on child threads
+ThreadResult gThreadResult[MAX_THREADS]; //Per-thread results, one cache line each so neighbouring threads never share a line
+volatile bool gCancelled; //Raised by the first thread that finds a zero; every other worker stops at its next chunk
+atomic_int gPendingThreads; //Threads that have not finished yet. Used with the futex-based solution
+atomic_int gCompletion; //Futex word: 0 while running, 1 once all threads are done or one of them found a zero
+
+ReduceEngine* gEngine; //Reduce engine with gThreadCount workers, used by the thread pool phase
+ReduceSpec gProdSpec; //The product as a reduce engine operation
+
+ValueHistogram gHistograms[MAX_THREADS]; //Per-thread counts for the histogram engine
+int gEngineChoice = ENGINE_AUTO; //-e auto|multiply|histogram
+bool gDataInDomain = true; //Every value in gData lies in [0, MAX_RANDOM_NUMBER]; checked when a dataset is loaded
+int gShardCount = 0; //-p processes; 0 runs every phase in this process
+
+// Hardware counters (-perf)
+bool gPerfEnabled = false;
+void* (*gCountedFunc[MAX_THREADS])(void*); //Thread function ThCounted runs for each thread number
+PerfCounters gParentPerf; //The parent's own counters, for the sequential phase
+PerfCounters gPoolPerf[MAX_THREADS]; //Opened by each pool worker the first time it folds a range
+atomic_int gPoolPerfCount; //Pool workers that have opened their counters
+atomic_long gPoolScanned; //Elements folded by the pool in the current phase
+
+ProdKernel gProdKernel; //The product kernel picked by SelectProdKernel
+const char* gProdKernelName; //Name of that kernel, for printing
+
+// Streaming mode
+StreamBuffer gStreamBuffers[STREAM_BUFFERS];
+long gStreamChunk = STREAM_CHUNK; //Elements per streaming buffer
+int gStreamFd; //Input being streamed
+volatile bool gStreamStop; //Set by the parent once a zero makes the rest of the input irrelevant
+pthread_mutex_t gStreamLock = PTHREAD_MUTEX_INITIALIZER; //Protects full/eof in gStreamBuffers
+pthread_cond_t gStreamCond = PTHREAD_COND_INITIALIZER; //Signalled whenever a buffer changes hands
 
 // Semaphores
 sem_t completed; //To notify parent that all threads have completed or one of them found a zero
 sem_t mutex; //Binary semaphore to protect the shared variable gDoneThreadCount
 
 // Function prototypes
+int RunSequentialPhase(int arraySize, int indices[MAX_THREADS][3]); //SqFindProd
+int RunJoinPhase(int arraySize, int indices[MAX_THREADS][3]); //ThFindProd, parent joins every thread
+int RunBusyWaitPhase(int arraySize, int indices[MAX_THREADS][3]); //ThFindProd, parent spins on the done flags
+int RunSemaphorePhase(int arraySize, int indices[MAX_THREADS][3]); //ThFindProdWithSemaphore, parent waits on "completed"
+int RunFutexPhase(int arraySize, int indices[MAX_THREADS][3]); //ThFindProdWithFutex, parent parks on gCompletion
+int RunPoolPhase(int arraySize, int indices[MAX_THREADS][3]); //Reduce engine on its persistent thread pool
+int RunHistogramPhase(int arraySize, int indices[MAX_THREADS][3]); //ThHistogram, then one exponentiation per distinct value
+void* ThHistogram(void* param); //Count the values in one division, stopping at a zero
+int PowMod(int base, long exp); //base^exp mod NUM_LIMIT by squaring
+bool UseHistogramEngine(int arraySize, int threadCount); //Does gEngineChoice pick the histogram engine for this problem?
+bool DataInDomain(int arraySize); //Do all of gData[0..arraySize-1] fit the histogram's value domain?
+int RunShardedMode(int arraySize, int shardCount); //Fork shardCount processes, each reducing one shard with gThreadCount threads
+void RunShard(int shard, long start, long end, int fd); //Body of one shard process: reduce gData[start..end] and write the result to fd
+void StopShards(pid_t* pids, struct pollfd* fds, int shardCount); //Kill the shards still running and reap every shard
+void StartWorker(pthread_t* tid, pthread_attr_t* attr, void* (*func)(void*), int* indices); //pthread_create, through ThCounted with -perf
+void* ThCounted(void* param); //Run gCountedFunc[threadNum] between two reads of this thread's counters
+void FinishCounted(void* param); //Cleanup handler of ThCounted: read the counters again and close them
+void PrintPerfStats(const PerfSample* perf, long bytes); //Print IPC, bytes/cycle and the raw counts for one phase
+void SetupEngine(ReduceSchedule schedule); //Create gEngine and gProdSpec for gThreadCount threads
+void MarkResult(void); //Record gResultNs and gResultCpuMs
+int RunBenchmark(int argc, char* argv[]); //Repeated, swept measurements of every phase in CSV or JSON
+int ParseList(const char* list, long* values, int max); //Parse "a,b,c" into values, returns how many
+int CompareLong(const void* a, const void* b); //qsort comparator
 int SqFindProd(int size); //Sequential FindProduct (no threads) computes the product of all the elements in the array mod NUM_LIMIT
 void* ThFindProd(void* param); //Thread FindProduct but without semaphores
 void* ThFindProdWithSemaphore(void* param); //Thread FindProduct with semaphores
+void* ThFindProdWithFutex(void* param); //Thread FindProduct that wakes the parent through the gCompletion futex
+void SignalCompletion(void); //Set gCompletion and wake the parent
+void WaitForCompletion(void); //Park until gCompletion is set
+void FoldProd(const void* base, long count, void* acc, const ReduceSpec* spec); //Reduce engine fold: run gProdKernel over one range
+void CombineProd(void* acc, const void* other, const ReduceSpec* spec); //Reduce engine combine: multiply two partial products
+bool MultiplyRange(int threadNum, long start, long end); //Multiply gData[start..end] into gThreadResult[threadNum].prod in cancellable chunks
+void PrintCancelStats(long drainNs); //Print the work wasted after the first zero was found
 int ComputeTotalProduct(); // Multiply the division products to compute the total modular product
 void InitSharedVars(); //Initialize shared variables
-void GenerateInput(int size, int indexForZero); //Generate the input array
+void PrintRunTime(const char* label, long ns, int runCount, int prod); //Print a timing line, with the per-run average when repeated
+int* AllocateData(long size); //Reserve a huge-page aligned buffer without touching it
+void GenerateInput(int size, int indices[MAX_THREADS][3]); //Generate the input array, one division per thread
+void* ThFirstTouch(void* param); //Thread function that faults in one division before serial generation
+void* ThGenerateInput(void* param); //Thread function that fills one division with the counter-based generator
+int CounterRand(long index, int min, int max); //The index-th number of the counter-based sequence, in [min, max]
+bool SaveDataset(const char* path, int size); //Write gData to a dataset file
+bool LoadDataset(const char* path, int size); //Map a dataset file in place of generating the input
+int RunStreamMode(const char* path, ReduceSchedule schedule); //Reduce a file or stdin in chunks with bounded memory
+void* ThStreamReader(void* param); //Reader thread that keeps the streaming ring filled
+long ReadFully(int fd, char* buf, long bytes); //read() until bytes arrive, the input ends or gStreamStop is set
 void CalculateIndices(int arraySize, int thrdCnt, int indices[MAX_THREADS][3]); //Calculate the indices to divide the array into T divisions, one division per thread
 int GetRand(int min, int max); //Get a random number between min and max
+int ProdKernelScalar(const int* data, int count); //One multiply and mod per element
+#ifdef HAVE_X86_KERNELS
+int ProdKernelAVX2(const int* data, int count); //32 independent lane products with Barrett reduction
+int ProdKernelAVX512(const int* data, int count); //64 independent lane products with Barrett reduction
+#endif
+bool SelectProdKernel(const char* name); //Pick a kernel by name, or the fastest one the CPU supports for "auto"
 
 //Timing functions
-long GetMilliSecondTime(struct timeb timeBuf);
+long GetNanoTime(void); //CLOCK_MONOTONIC in nanoseconds
 long GetCurrentTime(void);
 void SetTime(void);
 long GetTime(void);
+double GetThreadCpuMs(void); //CPU time used so far by the calling thread
+
+// Phases, in the order they run
+enum { PHASE_SEQUENTIAL, PHASE_JOIN, PHASE_BUSY_WAIT, PHASE_SEMAPHORE, PHASE_FUTEX, PHASE_POOL, PHASE_HISTOGRAM, PHASE_COUNT };
+Phase gPhases[PHASE_COUNT] = {
+    { "sequential", "Sequential multiplication", RunSequentialPhase },
+    { "join", "Threaded multiplication with parent waiting for all children", RunJoinPhase },
+    { "busywait", "Threaded multiplication with parent continually checking on children", RunBusyWaitPhase },
+    { "semaphore", "Threaded multiplication with parent waiting on a semaphore", RunSemaphorePhase },
+    { "futex", "Threaded multiplication with parent parked on a futex", RunFutexPhase },
+    { "pool", "Threaded multiplication with a persistent thread pool", RunPoolPhase },
+    { "histogram", "Threaded value histogram with one exponentiation per value", RunHistogramPhase },
+};
 
 int main(int argc, char* argv[]) {
-    pthread_t tid[MAX_THREADS];
-    pthread_attr_t attr[MAX_THREADS];
     int indices[MAX_THREADS][3];
-    int i, indexForZero, arraySize, prod;
+    int i, p, run, indexForZero, arraySize, prod, sequentialProd = 0;
+    long phaseNs[PHASE_COUNT]; //Average wall time of each phase, for the futex comparison
+    double phaseCpuMs[PHASE_COUNT]; //CPU time the parent burned while waiting in each phase
+    int runCount = 1;
+    const char* kernelName = "auto";
+    ReduceSchedule schedule = REDUCE_DYNAMIC;
+    const char* savePath = NULL;
+    const char* loadPath = NULL;
+    bool streamMode = argc >= 2 && strcmp(argv[1], "-stream") == 0;
+
+    if (argc >= 2 && strcmp(argv[1], "-bench") == 0) {
+        return RunBenchmark(argc, argv);
+    }
 
     // Code for parsing and checking command-line arguments
-    if (argc != 4) {
+    if (argc < 4) {
         fprintf(stderr, "Invalid number of arguments!\n");
+        fprintf(stderr, "Usage: MTFindProd arraySize threadCount indexForZero [-k auto|scalar|avx2|avx512] [-r runs] [-s static|dynamic]\n"
+                        "                  [-e auto|multiply|histogram] [-p processes] [-perf] [-g splitmix|legacy] [-save file] [-load file]\n"
+                        "       MTFindProd -stream file|- threadCount [-k kernel] [-s schedule] [-c chunkElements]\n"
+                        "       " BENCH_USAGE);
         exit(-1);
     }
 
-    if ((arraySize = atoi(argv[1])) <= 0 || arraySize > MAX_SIZE) {
+    if (streamMode) {
+        arraySize = 0;
+    } else if ((arraySize = atoi(argv[1])) <= 0 || arraySize > MAX_SIZE) {
         fprintf(stderr, "Invalid Array Size\n");
         exit(-1);
     }
-    gThreadCount = atoi(argv[2]);
+    gThreadCount = atoi(argv[streamMode ? 3 : 2]);
 
     if (gThreadCount > MAX_THREADS || gThreadCount <= 0) {
         fprintf(stderr, "Invalid Thread Count\n");
         exit(-1);
     }
 
-    indexForZero = atoi(argv[3]);
+    indexForZero = streamMode ? -1 : atoi(argv[3]);
 
-    if (indexForZero < -1 || indexForZero >= arraySize) {
+    if (!streamMode && (indexForZero < -1 || indexForZero >= arraySize)) {
         fprintf(stderr, "Invalid index for zero!\n");
         exit(-1);
     }
 
-    GenerateInput(arraySize, indexForZero);
+    for (i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            kernelName = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if ((runCount = atoi(argv[++i])) <= 0) {
+                fprintf(stderr, "Invalid run count\n");
+                exit(-1);
+            }
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && strcmp(argv[i + 1], "static") == 0) {
+            schedule = REDUCE_STATIC;
+            i++;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && strcmp(argv[i + 1], "dynamic") == 0) {
+            schedule = REDUCE_DYNAMIC;
+            i++;
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc && strcmp(argv[i + 1], "splitmix") == 0) {
+            gGenerator = GEN_SPLITMIX;
+            i++;
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc && strcmp(argv[i + 1], "legacy") == 0) {
+            gGenerator = GEN_LEGACY;
+            i++;
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && strcmp(argv[i + 1], "auto") == 0) {
+            gEngineChoice = ENGINE_AUTO;
+            i++;
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && strcmp(argv[i + 1], "multiply") == 0) {
+            gEngineChoice = ENGINE_MULTIPLY;
+            i++;
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && strcmp(argv[i + 1], "histogram") == 0) {
+            gEngineChoice = ENGINE_HISTOGRAM;
+            i++;
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if ((gShardCount = atoi(argv[++i])) <= 0 || gShardCount > MAX_SHARDS || gShardCount > arraySize) {
+                fprintf(stderr, "Invalid process count\n");
+                exit(-1);
+            }
+        } else if (strcmp(argv[i], "-perf") == 0) {
+            gPerfEnabled = true;
+        } else if (strcmp(argv[i], "-save") == 0 && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (strcmp(argv[i], "-load") == 0 && i + 1 < argc) {
+            loadPath = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            if ((gStreamChunk = atol(argv[++i])) < 1024) {
+                fprintf(stderr, "Invalid chunk size, use at least 1024 elements\n");
+                exit(-1);
+            }
+        } else {
+            fprintf(stderr, "Invalid option %s\n", argv[i]);
+            exit(-1);
+        }
+    }
+
+    if (!SelectProdKernel(kernelName)) {
+        fprintf(stderr, "Product kernel %s is not available on this CPU\n", kernelName);
+        exit(-1);
+    }
+    printf("Using the %s product kernel\n", gProdKernelName);
+
+    if (streamMode) {
+        return RunStreamMode(argv[2], schedule);
+    }
+
     CalculateIndices(arraySize, gThreadCount, indices);
 
-    // Code for the sequential part
+    // Either map a saved dataset or generate one, optionally saving it for the next run.
+    // The zero is placed afterwards so one file serves every indexForZero
     SetTime();
+    if (loadPath != NULL) {
+        if (!LoadDataset(loadPath, arraySize)) {
+            exit(-1);
+        }
+        printf("Loaded %d elements from %s in %ld ms\n", arraySize, loadPath, GetTime());
+        gDataInDomain = DataInDomain(arraySize);
+        if (!gDataInDomain && gEngineChoice == ENGINE_HISTOGRAM) {
+            printf("Loaded values lie outside [0, %d], so the histogram engine is skipped\n", MAX_RANDOM_NUMBER);
+        }
+    } else {
+        if ((gData = AllocateData(arraySize)) == NULL) {
+            fprintf(stderr, "Error: cannot allocate %d elements\n", arraySize);
+            exit(-1);
+        }
+        GenerateInput(arraySize, indices);
+        printf("Generated %d elements in %ld ms\n", arraySize, GetTime());
+        if (savePath != NULL && !SaveDataset(savePath, arraySize)) {
+            exit(-1);
+        }
+    }
+
+    if (indexForZero >= 0) {
+        gData[indexForZero] = 0;
+    }
+
+    if (gShardCount > 0) {
+        return RunShardedMode(arraySize, gShardCount);
+    }
+
+    // Counters are optional: without a PMU or with a strict perf_event_paranoid the timings still run
+    if (gPerfEnabled) {
+        const char* reason = "";
+        if (!PerfAvailable(&reason) || !PerfOpenThread(&gParentPerf)) {
+            printf("Hardware counters unavailable: %s\n", reason);
+            gPerfEnabled = false;
+        }
+    }
+
+    SetupEngine(schedule);
+
+    // Run every phase: sequential, join, busy-wait, semaphore, futex, thread pool and, when the engine
+    // choice allows it, the histogram. With -r each phase is repeated and the per-run average is reported
+    for (p = 0; p < PHASE_COUNT; p++) {
+        long totalNs = 0, scanned = 0;
+        double cpuMs = 0;
+        PerfSample perf;
+
+        PerfSampleClear(&perf);
+
+        if (p == PHASE_HISTOGRAM && !UseHistogramEngine(arraySize, gThreadCount)) {
+            continue;
+        }
+
+        for (run = 0; run < runCount; run++) {
+            long startNs = GetNanoTime();
+            double cpuStart = GetThreadCpuMs();
+
+            prod = gPhases[p].run(arraySize, indices);
+            totalNs += gResultNs - startNs;
+            cpuMs += gResultCpuMs - cpuStart;
+
+            for (i = 0; i < MAX_THREADS; i++) {
+                PerfSampleAdd(&perf, &gThreadResult[i].perf);
+                scanned += gThreadResult[i].scanned;
+            }
+        }
+
+        phaseNs[p] = totalNs / runCount;
+        phaseCpuMs[p] = cpuMs / runCount;
+        PrintRunTime(gPhases[p].label, totalNs, runCount, prod);
+        PrintCancelStats(gDrainNs);
+        if (gPerfEnabled) {
+            PrintPerfStats(&perf, scanned * (long) sizeof(int));
+        }
+
+        if (p == PHASE_SEQUENTIAL) {
+            sequentialProd = prod;
+        } else if (p == PHASE_HISTOGRAM && prod != sequentialProd) {
+            fprintf(stderr, "Error: histogram product %d does not match sequential product %d\n", prod, sequentialProd);
+            exit(-1);
+        }
+
+        if (p == PHASE_FUTEX) {
+            printf("    Futex wait vs join: %+.3f ms, vs busy-wait: %+.3f ms, vs semaphore: %+.3f ms\n",
+                   (phaseNs[PHASE_FUTEX] - phaseNs[PHASE_JOIN]) / 1e6, (phaseNs[PHASE_FUTEX] - phaseNs[PHASE_BUSY_WAIT]) / 1e6,
+                   (phaseNs[PHASE_FUTEX] - phaseNs[PHASE_SEMAPHORE]) / 1e6);
+            printf("    Parent CPU while waiting: join %.1f ms, busy-wait %.1f ms, semaphore %.1f ms, futex %.1f ms\n",
+                   phaseCpuMs[PHASE_JOIN], phaseCpuMs[PHASE_BUSY_WAIT], phaseCpuMs[PHASE_SEMAPHORE], phaseCpuMs[PHASE_FUTEX]);
+        }
+    }
+
+    ReduceEngineDestroy(gEngine);
+    return 0;
+}
+
+// Code for the sequential part
+int RunSequentialPhase(int arraySize, int indices[MAX_THREADS][3]) {
+    PerfSample start, end;
+    int prod;
+
+    InitSharedVars();
+    if (gPerfEnabled) {
+        PerfRead(&gParentPerf, &start);
+    }
     prod = SqFindProd(arraySize);
-    printf("Sequential multiplication completed in %ld ms. Product = %d\n", GetTime(), prod);
+    MarkResult();
+    if (gPerfEnabled) {
+        PerfRead(&gParentPerf, &end);
+        PerfSampleDelta(&gThreadResult[0].perf, &end, &start);
+    }
+    gThreadResult[0].scanned = arraySize;
+    return prod;
+}
+
+// Threaded with parent waiting for all child threads
+int RunJoinPhase(int arraySize, int indices[MAX_THREADS][3]) {
+    pthread_t tid[MAX_THREADS];
+    pthread_attr_t attr[MAX_THREADS];
+    int i;
 
-    // Threaded with parent waiting for all child threads
     InitSharedVars();
-    SetTime();
 
     // Initialize threads, create threads
     // The thread start function is ThFindProd
     for (i = 0; i < gThreadCount; i++) {
         pthread_attr_init(&attr[i]);
-        pthread_create(&tid[i], &attr[i], ThFindProd, indices[i]);
+        StartWorker(&tid[i], &attr[i], ThFindProd, indices[i]);
     }
 
     // let the parent wait for all threads using pthread_join
@@ -144,103 +530,501 @@ int main(int argc, char* argv[]) {
         pthread_join(tid[i], NULL);
     }
 
-    prod = ComputeTotalProduct();
-    printf("Threaded multiplication with parent waiting for all children completed in %ld ms. Product = %d\n", GetTime(), prod);
+    int prod = ComputeTotalProduct();
+    MarkResult();
+    return prod;
+}
+
+// Multi-threaded with busy waiting (parent continually checking on child threads without using semaphores)
+int RunBusyWaitPhase(int arraySize, int indices[MAX_THREADS][3]) {
+    pthread_t tid[MAX_THREADS];
+    pthread_attr_t attr[MAX_THREADS];
+    int i;
 
-    // Multi-threaded with busy waiting (parent continually checking on child threads without using semaphores)
     InitSharedVars();
-    SetTime();
 
     // Initialize threads, create threads, and then make the parent continually check on all child threads
     // The thread start function is ThFindProd
-    for (i = 0; i <gThreadCount; i++) {
+    for (i = 0; i < gThreadCount; i++) {
         pthread_attr_init(&attr[i]);
-        pthread_create(&tid[i], &attr[i], ThFindProd, indices[i]);
+        StartWorker(&tid[i], &attr[i], ThFindProd, indices[i]);
     }
 
+    // Stop checking as soon as any thread has found a zero
     bool allDone = false;
-    while (!allDone) {
+    while (!allDone && !gCancelled) {
         allDone = true;
         for (i = 0; i < gThreadCount; i++) {
-            if (!gThreadDone[i]) {
+            if (!gThreadResult[i].done) {
                 allDone = false;
                 break;
             }
         }
     }
 
-    prod = ComputeTotalProduct();
-    printf("Threaded multiplication with parent continually checking on children completed in %ld ms. Product = %d\n", GetTime(), prod);
+    int prod = ComputeTotalProduct();
+    MarkResult();
+
+    // The answer is known; the rest of the children stop within one chunk
+    for (i = 0; i < gThreadCount; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    gDrainNs = GetNanoTime() - gResultNs;
+    return prod;
+}
+
+// Multi-threaded with semaphores
+int RunSemaphorePhase(int arraySize, int indices[MAX_THREADS][3]) {
+    pthread_t tid[MAX_THREADS];
+    pthread_attr_t attr[MAX_THREADS];
+    int i;
 
-    // Multi-threaded with semaphores
     InitSharedVars();
     // Initialize your semaphores here
     sem_init(&completed, 0, 0);
     sem_init(&mutex, 0, 1);
-    SetTime();
 
     // Initialize threads, create threads, and then make the parent wait on the "completed" semaphore
     // The thread start function is ThFindProdWithSemaphore
     for (i = 0; i < gThreadCount; i++) {
         pthread_attr_init(&attr[i]);
-        pthread_create(&tid[i], &attr[i], ThFindProdWithSemaphore, indices[i]);
+        StartWorker(&tid[i], &attr[i], ThFindProdWithSemaphore, indices[i]);
     }
 
     sem_wait(&completed);
 
-    prod = ComputeTotalProduct();
-    printf("Threaded multiplication with parent waiting on a semaphore completed in %ld ms. Product = %d\n", GetTime(), prod);
+    int prod = ComputeTotalProduct();
+    MarkResult();
+
+    for (i = 0; i < gThreadCount; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    gDrainNs = GetNanoTime() - gResultNs;
 
     // Cleanup semaphores
     sem_destroy(&completed);
     sem_destroy(&mutex);
-    return 0;
+    return prod;
 }
 
-// Write a regular sequential function to multiply all the elements in gData mod NUM_LIMIT
-// REMEMBER TO MOD BY NUM_LIMIT AFTER EACH MULTIPLICATION TO PREVENT YOUR PRODUCT VARIABLE FROM OVERFLOWING
-int SqFindProd(int size) {
-    int prod = 1;
+// Multi-threaded with the parent parked on a futex (a condition variable where futexes don't exist)
+// The last thread to finish, or the first to find a zero, sets gCompletion and wakes the parent
+int RunFutexPhase(int arraySize, int indices[MAX_THREADS][3]) {
+    pthread_t tid[MAX_THREADS];
+    pthread_attr_t attr[MAX_THREADS];
+    int i;
 
-    for (int i =0; i < size; i++) {
-        if (gData[i] == 0) {
-            return 0;
+    InitSharedVars();
+
+    for (i = 0; i < gThreadCount; i++) {
+        pthread_attr_init(&attr[i]);
+        StartWorker(&tid[i], &attr[i], ThFindProdWithFutex, indices[i]);
+    }
+
+    WaitForCompletion();
+
+    int prod = ComputeTotalProduct();
+    MarkResult();
+
+    for (i = 0; i < gThreadCount; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    gDrainNs = GetNanoTime() - gResultNs;
+    return prod;
+}
+
+// Multi-threaded on the generic reduce engine and its persistent thread pool
+// The workers are created once; each reduction is submitted as a job, statically sliced or split and stolen on demand
+int RunPoolPhase(int arraySize, int indices[MAX_THREADS][3]) {
+    ReduceStats stats;
+    PerfSample start[MAX_THREADS], end;
+    int prod, i;
+
+    InitSharedVars();
+    // Workers that open their counters during this job start from zero
+    for (i = 0; i < MAX_THREADS; i++) {
+        PerfSampleZero(&start[i]);
+        if (gPerfEnabled && i < atomic_load(&gPoolPerfCount)) {
+            PerfRead(&gPoolPerf[i], &start[i]);
         }
-        prod = (prod * gData[i]) % NUM_LIMIT;
     }
 
+    gProdSpec.data = gData;
+    gProdSpec.count = arraySize;
+    ParallelReduce(gEngine, &gProdSpec, &prod, &stats);
+    MarkResult();
+
+    for (i = 0; gPerfEnabled && i < atomic_load(&gPoolPerfCount); i++) {
+        PerfRead(&gPoolPerf[i], &end);
+        PerfSampleDelta(&gThreadResult[i].perf, &end, &start[i]);
+    }
+    gThreadResult[0].scanned = atomic_load(&gPoolScanned);
+
+    // Report early termination through the same fields as the other phases
+    gCancelled = stats.absorbed;
+    gThreadResult[0].wasted = stats.wasted;
+    return prod;
+}
+
+// Multi-threaded histogram: each thread counts the values in its division, then the parent raises every
+// value to its total count. The 100M dependent multiply-mods become independent counter increments plus
+// at most HIST_DOMAIN exponentiations. UseHistogramEngine keeps input outside the domain away from it;
+// if such a value turns up anyway the division is multiplied instead
+int RunHistogramPhase(int arraySize, int indices[MAX_THREADS][3]) {
+    pthread_t tid[MAX_THREADS];
+    int i, v, lane;
+
+    InitSharedVars();
+
+    for (i = 0; i < gThreadCount; i++) {
+        StartWorker(&tid[i], NULL, ThHistogram, indices[i]);
+    }
+    for (i = 0; i < gThreadCount; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    for (i = 0; i < gThreadCount; i++) {
+        if (gHistograms[i].outOfDomain) {
+            return RunJoinPhase(arraySize, indices);
+        }
+    }
+
+    int prod = 1;
+    if (!gCancelled) {
+        for (v = 1; v < HIST_DOMAIN && prod != 0; v++) {
+            long count = 0;
+            for (i = 0; i < gThreadCount; i++) {
+                for (lane = 0; lane < HIST_LANES; lane++) {
+                    count += gHistograms[i].count[lane][v];
+                }
+            }
+            if (count > 0) {
+                prod = (prod * PowMod(v, count)) % NUM_LIMIT;
+            }
+        }
+    } else {
+        prod = 0;
+    }
+
+    MarkResult();
     return prod;
 }
 
+void* ThHistogram(void* param) {
+    int* indices = (int*) param;
+    int threadNum = indices[0];
+    ValueHistogram* hist = &gHistograms[threadNum];
+
+    memset(hist->count, 0, sizeof(hist->count));
+    hist->outOfDomain = false;
+
+    for (long chunkStart = indices[1]; chunkStart <= indices[2]; chunkStart += CANCEL_CHUNK) {
+        if (gCancelled) {
+            return NULL;
+        }
+
+        long chunkEnd = (chunkStart + CANCEL_CHUNK - 1 < indices[2]) ? chunkStart + CANCEL_CHUNK - 1 : indices[2];
+        long i = chunkStart;
+
+        for (; i + HIST_LANES - 1 <= chunkEnd; i += HIST_LANES) {
+            for (int lane = 0; lane < HIST_LANES; lane++) {
+                unsigned int v = gData[i + lane];
+                if (v >= HIST_DOMAIN) {
+                    hist->outOfDomain = true;
+                    return NULL;
+                }
+                hist->count[lane][v]++;
+            }
+        }
+        for (; i <= chunkEnd; i++) {
+            unsigned int v = gData[i];
+            if (v >= HIST_DOMAIN) {
+                hist->outOfDomain = true;
+                return NULL;
+            }
+            hist->count[0][v]++;
+        }
+
+        gThreadResult[threadNum].scanned += chunkEnd - chunkStart + 1;
+        if (hist->count[0][0] + hist->count[1][0] + hist->count[2][0] + hist->count[3][0] > 0) {
+            gThreadResult[threadNum].prod = 0;
+            gCancelled = true;
+            return NULL;
+        }
+        if (gCancelled) {
+            gThreadResult[threadNum].wasted += chunkEnd - chunkStart + 1;
+        }
+    }
+
+    return NULL;
+}
+
+int PowMod(int base, long exp) {
+    int result = 1;
+
+    base %= NUM_LIMIT;
+    while (exp > 0) {
+        if (exp & 1) {
+            result = (result * base) % NUM_LIMIT;
+        }
+        base = (base * base) % NUM_LIMIT;
+        exp >>= 1;
+    }
+
+    return result;
+}
+
+// The histogram only applies when every value is in its domain, which is checked once per dataset, not
+// discovered halfway through the phase. It also pays for zeroing and merging HIST_DOMAIN counters per
+// thread, so "auto" only picks it once every thread has many elements per counter
+bool UseHistogramEngine(int arraySize, int threadCount) {
+    if (!gDataInDomain) {
+        return false;
+    }
+    if (gEngineChoice == ENGINE_AUTO) {
+        return arraySize / threadCount >= HIST_MIN_ELEMENTS;
+    }
+    return gEngineChoice == ENGINE_HISTOGRAM;
+}
+
+// Generated input always fits the domain; a loaded dataset may hold anything
+bool DataInDomain(int arraySize) {
+    for (int i = 0; i < arraySize; i++) {
+        if ((unsigned int) gData[i] >= HIST_DOMAIN) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Multi-process sharded mode: the input lives in a shared mapping (or a dataset file mapped before the fork),
+// so every process sees the same pages. Each child reduces one contiguous shard with gThreadCount threads and
+// writes a ShardResult to its own pipe. The parent multiplies the shard products as they arrive, and the first
+// zero makes it kill the shards that are still running, the way a coordinator would give up on other boxes
+int RunShardedMode(int arraySize, int shardCount) {
+    pid_t pids[MAX_SHARDS];
+    struct pollfd fds[MAX_SHARDS];
+    int pending = shardCount, prod = 1, i;
+    long shardSize = arraySize / shardCount;
+
+    long startNs = GetNanoTime();
+    int sequentialProd = RunSequentialPhase(arraySize, NULL);
+    PrintRunTime(gPhases[PHASE_SEQUENTIAL].label, gResultNs - startNs, 1, sequentialProd);
+
+    fflush(stdout); //Or the children inherit the buffered output and print it again
+    startNs = GetNanoTime();
+
+    for (i = 0; i < shardCount; i++) {
+        int fd[2];
+        long start = i * shardSize;
+        long end = (i == shardCount - 1) ? arraySize - 1 : start + shardSize - 1;
+
+        if (pipe(fd) != 0) {
+            perror("pipe");
+            StopShards(pids, fds, i);
+            exit(-1);
+        }
+        if ((pids[i] = fork()) < 0) {
+            perror("fork");
+            close(fd[0]);
+            close(fd[1]);
+            StopShards(pids, fds, i);
+            exit(-1);
+        }
+        if (pids[i] == 0) {
+            close(fd[0]);
+            RunShard(i, start, end, fd[1]);
+            _exit(0);
+        }
+        close(fd[1]);
+        fds[i].fd = fd[0];
+        fds[i].events = POLLIN;
+    }
+
+    while (pending > 0 && prod != 0) {
+        if (poll(fds, shardCount, -1) < 0) {
+            perror("poll");
+            StopShards(pids, fds, shardCount);
+            exit(-1);
+        }
+        for (i = 0; i < shardCount; i++) {
+            ShardResult result;
+
+            if (fds[i].fd < 0 || fds[i].revents == 0) {
+                continue;
+            }
+            if (read(fds[i].fd, &result, sizeof(result)) != sizeof(result)) {
+                fprintf(stderr, "Error: shard %d exited without a result\n", i);
+                StopShards(pids, fds, shardCount);
+                exit(-1);
+            }
+            printf("    Shard %d: elements %ld..%ld, product %d in %.3f ms\n", result.shard, i * shardSize,
+                   (i == shardCount - 1) ? arraySize - 1 : (i + 1) * shardSize - 1, result.prod, result.ns / 1e6);
+            prod = (prod * result.prod) % NUM_LIMIT;
+            close(fds[i].fd);
+            fds[i].fd = -1; //poll ignores negative descriptors
+            pending--;
+        }
+    }
+    long resultNs = GetNanoTime() - startNs;
+
+    // A zero makes the other shards irrelevant
+    StopShards(pids, fds, shardCount);
+
+    printf("Sharded multiplication over %d processes with %d threads each completed in %.3f ms. Product = %d\n",
+           shardCount, gThreadCount, resultNs / 1e6, prod);
+    if (pending > 0) {
+        printf("    Cancelled after the first zero: %d shards killed, all processes gone %.3f ms after the result\n",
+               pending, (GetNanoTime() - startNs - resultNs) / 1e6);
+    }
+
+    if (prod != sequentialProd) {
+        fprintf(stderr, "Error: sharded product %d does not match sequential product %d\n", prod, sequentialProd);
+        exit(-1);
+    }
+    return 0;
+}
+
+// Kill every shard that hasn't reported yet and reap them all, so no shard outlives the parent
+void StopShards(pid_t* pids, struct pollfd* fds, int shardCount) {
+    for (int i = 0; i < shardCount; i++) {
+        if (fds[i].fd >= 0) {
+            kill(pids[i], SIGKILL);
+            close(fds[i].fd);
+            fds[i].fd = -1;
+        }
+    }
+    for (int i = 0; i < shardCount; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+}
+
+void RunShard(int shard, long start, long end, int fd) {
+    int indices[MAX_THREADS][3];
+    ShardResult result;
+    long startNs = GetNanoTime();
+    int threads = gThreadCount;
+
+    // Divide the shard between this process's threads, the same way main divides the whole array
+    if (end - start + 1 < threads) {
+        threads = end - start + 1;
+    }
+    gThreadCount = threads;
+    CalculateIndices(end - start + 1, threads, indices);
+    for (int i = 0; i < threads; i++) {
+        indices[i][1] += start;
+        indices[i][2] += start;
+    }
+
+    result.shard = shard;
+    result.prod = RunFutexPhase(end - start + 1, indices);
+    result.ns = GetNanoTime() - startNs;
+    if (write(fd, &result, sizeof(result)) != sizeof(result)) {
+        perror("write");
+    }
+    close(fd);
+}
+
+void StartWorker(pthread_t* tid, pthread_attr_t* attr, void* (*func)(void*), int* indices) {
+    if (!gPerfEnabled) {
+        pthread_create(tid, attr, func, indices);
+        return;
+    }
+    gCountedFunc[indices[0]] = func;
+    pthread_create(tid, attr, ThCounted, indices);
+}
+
+// Counters are opened inside the worker so they follow that thread. The thread functions end with
+// pthread_exit, so the final read is a cleanup handler rather than code after the call
+void* ThCounted(void* param) {
+    int threadNum = ((int*) param)[0];
+    PerfCounters counters;
+    PerfSample start;
+
+    if (!PerfOpenThread(&counters)) {
+        return gCountedFunc[threadNum](param);
+    }
+    PerfRead(&counters, &start);
+
+    void* counted[3] = { &counters, &start, &gThreadResult[threadNum].perf };
+    pthread_cleanup_push(FinishCounted, counted);
+    gCountedFunc[threadNum](param);
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+void FinishCounted(void* param) {
+    void** counted = (void**) param;
+    PerfSample end;
+
+    PerfRead(counted[0], &end);
+    PerfSampleDelta(counted[2], &end, counted[1]);
+    PerfClose(counted[0]);
+}
+
+// IPC says whether the workers are stalled (on memory or the % latency chain) or retiring work;
+// bytes/cycle against the machine's bandwidth per core says whether memory is the limit
+void PrintPerfStats(const PerfSample* perf, long bytes) {
+    long long cycles = perf->value[PERF_CYCLES];
+    long long instructions = perf->value[PERF_INSTRUCTIONS];
+
+    printf("    Counters:");
+    if (cycles > 0 && instructions >= 0) {
+        printf(" IPC %.2f,", (double) instructions / cycles);
+    }
+    if (cycles > 0) {
+        printf(" %.2f bytes/cycle,", (double) bytes / cycles);
+    }
+    printf(" cycles %lld, instructions %lld, LLC misses %lld, branch misses %lld (-1 = not counted)\n",
+           cycles, instructions, perf->value[PERF_LLC_MISSES], perf->value[PERF_BRANCH_MISSES]);
+}
+
+// Start the reduce engine for gThreadCount threads and describe the product as a REDUCE_CUSTOM operation on it
+void SetupEngine(ReduceSchedule schedule) {
+    static const int one = 1, zero = 0;
+
+    gEngine = ReduceEngineCreate(gThreadCount);
+    ReduceSpecInit(&gProdSpec, REDUCE_CUSTOM, REDUCE_INT32, gData, 0);
+    gProdSpec.elemSize = sizeof(int);
+    gProdSpec.accSize = sizeof(int);
+    gProdSpec.identity = &one;
+    gProdSpec.absorbing = &zero;
+    gProdSpec.reduceRange = FoldProd;
+    gProdSpec.combine = CombineProd;
+    gProdSpec.schedule = schedule;
+}
+
+// Record when, and after how much parent CPU time, the product was known
+void MarkResult(void) {
+    gResultNs = GetNanoTime();
+    gResultCpuMs = GetThreadCpuMs();
+}
+
+// Write a regular sequential function to multiply all the elements in gData mod NUM_LIMIT
+// REMEMBER TO MOD BY NUM_LIMIT AFTER EACH MULTIPLICATION TO PREVENT YOUR PRODUCT VARIABLE FROM OVERFLOWING
+int SqFindProd(int size) {
+    return gProdKernel(gData, size);
+}
+
 // Write a thread function that computes the product of all the elements in one division of the array mod NUM_LIMIT
 // REMEMBER TO MOD BY NUM_LIMIT AFTER EACH MULTIPLICATION TO PREVENT YOUR PRODUCT VARIABLE FROM OVERFLOWING
-// When it is done, this function should store the product in gThreadProd[threadNum] and set gThreadDone[threadNum] to true
+// When it is done, this function should store the product in gThreadResult[threadNum].prod and set gThreadResult[threadNum].done to true
 void* ThFindProd(void* param) {
     int* indices = (int*) param;
     int threadNum = indices[0];
     int start = indices[1];
     int end = indices[2];
 
-    int prod = 1;
-
-    for (int i = start; i <= end; i++) {
-        if (gData[i] == 0) {
-            gThreadProd[threadNum] = 0;
-            gThreadDone[threadNum] = true;
-            pthread_exit(0);
-        }
-        prod = (prod * gData[i]) % NUM_LIMIT;
-    }
-
-    gThreadProd[threadNum] = prod;
-    gThreadDone[threadNum] = true;
+    MultiplyRange(threadNum, start, end);
+    gThreadResult[threadNum].done = true;
 
     pthread_exit(0);
 }
 
 // Write a thread function that computes the product of all the elements in one division of the array mod NUM_LIMIT
 // REMEMBER TO MOD BY NUM_LIMIT AFTER EACH MULTIPLICATION TO PREVENT YOUR PRODUCT VARIABLE FROM OVERFLOWING
-// When it is done, this function should store the product in gThreadProd[threadNum]
+// When it is done, this function should store the product in gThreadResult[threadNum].prod
 // If the product value in this division is zero, this function should post the "completed" semaphore
 // If the product value in this division is not zero, this function should increment gDoneThreadCount and
 // post the "completed" semaphore if it is the last thread to be done
@@ -251,19 +1035,14 @@ void* ThFindProdWithSemaphore(void* param) {
     int start = indices[1];
     int end = indices[2];
 
-    int prod = 1;
-
-    for (int i = start; i <= end; i++) {
-        if (gData[i] == 0) {
-            gThreadProd[threadNum] = 0;
+    if (!MultiplyRange(threadNum, start, end)) {
+        // Only the thread that found the zero posts; the others were cancelled by it
+        if (gThreadResult[threadNum].prod == 0) {
             sem_post(&completed);
-            pthread_exit(0);
         }
-        prod = (prod * gData[i]) % NUM_LIMIT;
+        pthread_exit(0);
     }
 
-    gThreadProd[threadNum] = prod;
-
     sem_wait(&mutex);
     gDoneThreadCount++;
     if (gDoneThreadCount == gThreadCount) {
@@ -274,11 +1053,114 @@ void* ThFindProdWithSemaphore(void* param) {
     pthread_exit(0);
 }
 
+// Same work as ThFindProd, but completion is reported through gPendingThreads and the gCompletion futex:
+// the thread that finds a zero, or the last one to finish, wakes the parent
+void* ThFindProdWithFutex(void* param) {
+    int* indices = (int*) param;
+    int threadNum = indices[0];
+    int start = indices[1];
+    int end = indices[2];
+
+    if (!MultiplyRange(threadNum, start, end)) {
+        if (gThreadResult[threadNum].prod == 0) {
+            SignalCompletion();
+        }
+        pthread_exit(0);
+    }
+
+    if (atomic_fetch_sub(&gPendingThreads, 1) == 1) {
+        SignalCompletion();
+    }
+
+    pthread_exit(0);
+}
+
+#ifdef __linux__
+void SignalCompletion(void) {
+    atomic_store(&gCompletion, 1);
+    syscall(SYS_futex, &gCompletion, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// FUTEX_WAIT only sleeps if gCompletion is still 0, so a wake that lands before the parent parks is not lost
+void WaitForCompletion(void) {
+    while (atomic_load(&gCompletion) == 0) {
+        syscall(SYS_futex, &gCompletion, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+    }
+}
+#else
+pthread_mutex_t gCompletionLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t gCompletionCond = PTHREAD_COND_INITIALIZER;
+
+void SignalCompletion(void) {
+    pthread_mutex_lock(&gCompletionLock);
+    atomic_store(&gCompletion, 1);
+    pthread_cond_signal(&gCompletionCond);
+    pthread_mutex_unlock(&gCompletionLock);
+}
+
+void WaitForCompletion(void) {
+    pthread_mutex_lock(&gCompletionLock);
+    while (atomic_load(&gCompletion) == 0) {
+        pthread_cond_wait(&gCompletionCond, &gCompletionLock);
+    }
+    pthread_mutex_unlock(&gCompletionLock);
+}
+#endif
+
+// The product kernel as a REDUCE_CUSTOM operation, so the pool phase runs on the shared reduce engine
+void FoldProd(const void* base, long count, void* acc, const ReduceSpec* spec) {
+    static __thread bool perfOpened = false;
+
+    // The pool's threads aren't ours to start, so each opens its counters on its first range
+    if (gPerfEnabled && !perfOpened) {
+        int slot = atomic_fetch_add(&gPoolPerfCount, 1);
+        perfOpened = true;
+        if (slot < MAX_THREADS) {
+            PerfOpenThread(&gPoolPerf[slot]);
+        }
+    }
+    atomic_fetch_add_explicit(&gPoolScanned, count, memory_order_relaxed);
+
+    int prod = gProdKernel((const int*) base, (int) count);
+    *(int*) acc = (*(int*) acc * prod) % NUM_LIMIT;
+}
+
+void CombineProd(void* acc, const void* other, const ReduceSpec* spec) {
+    *(int*) acc = (*(int*) acc * *(const int*) other) % NUM_LIMIT;
+}
+
+// Multiply gData[start..end] into gThreadResult[threadNum].prod one CANCEL_CHUNK at a time, checking gCancelled before each chunk.
+// Returns true if the range ran to completion, false if this thread found a zero (its product is then 0 and
+// gCancelled is raised) or another thread had already raised gCancelled
+bool MultiplyRange(int threadNum, long start, long end) {
+    for (long chunkStart = start; chunkStart <= end; chunkStart += CANCEL_CHUNK) {
+        if (gCancelled) {
+            return false;
+        }
+
+        int count = (end - chunkStart + 1 < CANCEL_CHUNK) ? (int) (end - chunkStart + 1) : CANCEL_CHUNK;
+        int prod = gProdKernel(&gData[chunkStart], count);
+        gThreadResult[threadNum].scanned += count;
+
+        if (prod == 0) {
+            gThreadResult[threadNum].prod = 0;
+            gCancelled = true;
+            return false;
+        }
+        if (gCancelled) {
+            gThreadResult[threadNum].wasted += count;
+        }
+        gThreadResult[threadNum].prod = (gThreadResult[threadNum].prod * prod) % NUM_LIMIT;
+    }
+
+    return true;
+}
+
 int ComputeTotalProduct() {
     int i, prod = 1;
 
     for (i = 0; i < gThreadCount; i++) {
-        prod *= gThreadProd[i];
+        prod *= gThreadResult[i].prod;
         prod %= NUM_LIMIT;
     }
 
@@ -289,26 +1171,577 @@ void InitSharedVars() {
     int i;
 
     for (i = 0; i < gThreadCount; i++) {
-        gThreadDone[i] = false;
-        gThreadProd[i] = 1;
+        gThreadResult[i].done = false;
+        gThreadResult[i].prod = 1;
+        gThreadResult[i].wasted = 0;
+    }
+    for (i = 0; i < MAX_THREADS; i++) {
+        gThreadResult[i].scanned = 0;
+        PerfSampleClear(&gThreadResult[i].perf);
     }
+    atomic_store(&gPoolScanned, 0);
     gDoneThreadCount = 0;
+    gCancelled = false;
+    gDrainNs = -1;
+    atomic_store(&gPendingThreads, gThreadCount);
+    atomic_store(&gCompletion, 0);
+}
+
+// Map exactly size elements, rounded up to and aligned on HUGE_PAGE_SIZE and marked MADV_HUGEPAGE, so
+// transparent huge pages can back it. Nothing is touched here: each page is placed on the NUMA node of
+// the thread that first writes it, which is the thread that owns that division
+int* AllocateData(long size) {
+    size_t bytes = (size * sizeof(int) + HUGE_PAGE_SIZE - 1) & ~((size_t) HUGE_PAGE_SIZE - 1);
+    size_t mapped = bytes + HUGE_PAGE_SIZE;
+    int sharing = gShardCount > 0 ? MAP_SHARED : MAP_PRIVATE; //Shard processes map the same pages, not copies
+    char* raw = mmap(NULL, mapped, PROT_READ | PROT_WRITE, sharing | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Trim the unaligned head and the unused tail of the over-sized mapping
+    char* aligned = (char*) (((uintptr_t) raw + HUGE_PAGE_SIZE - 1) & ~((uintptr_t) HUGE_PAGE_SIZE - 1));
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    if (raw + mapped > aligned + bytes) {
+        munmap(aligned + bytes, raw + mapped - (aligned + bytes));
+    }
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+    return (int*) aligned;
 }
 
 // Write a function that fills the gData array with random numbers between 1 and MAX_RANDOM_NUMBER
-// If indexForZero is valid and non-negative, set the value at that index to zero
-void GenerateInput(int size, int indexForZero) {
-    srand(RANDOM_SEED);
+// The counter-based generator runs one thread per division and gives the same array for any thread count;
+// the legacy rand() sequence can only be produced serially, so its pages are first touched by the owning threads
+void GenerateInput(int size, int indices[MAX_THREADS][3]) {
+    pthread_t tid[MAX_THREADS];
+
+    if (gGenerator == GEN_LEGACY) {
+        for (int i = 0; i < gThreadCount; i++) {
+            pthread_create(&tid[i], NULL, ThFirstTouch, indices[i]);
+        }
+        for (int i = 0; i < gThreadCount; i++) {
+            pthread_join(tid[i], NULL);
+        }
 
-    for (int i = 0; i < size; i++) {
-        gData[i] = GetRand(1, MAX_RANDOM_NUMBER);
+        srand(RANDOM_SEED);
+
+        for (int i = 0; i < size; i++) {
+            gData[i] = GetRand(1, MAX_RANDOM_NUMBER);
+        }
+        return;
     }
 
-    if (indexForZero >= 0) {
-        gData[indexForZero] = 0;
+    for (int i = 0; i < gThreadCount; i++) {
+        pthread_create(&tid[i], NULL, ThGenerateInput, indices[i]);
+    }
+    for (int i = 0; i < gThreadCount; i++) {
+        pthread_join(tid[i], NULL);
+    }
+}
+
+void* ThGenerateInput(void* param) {
+    int* indices = (int*) param;
+
+    for (int i = indices[1]; i <= indices[2]; i++) {
+        gData[i] = CounterRand(i, 1, MAX_RANDOM_NUMBER);
+    }
+
+    return NULL;
+}
+
+void* ThFirstTouch(void* param) {
+    int* indices = (int*) param;
+
+    memset(&gData[indices[1]], 0, (indices[2] - indices[1] + 1) * sizeof(int));
+    return NULL;
+}
+
+// splitmix64 evaluated at position index of the RANDOM_SEED stream, so jumping ahead costs nothing.
+// The high 32 bits are scaled into [x, y] with a multiply instead of a %
+int CounterRand(long index, int x, int y) {
+    uint64_t z = ((uint64_t) RANDOM_SEED << 32) + (uint64_t) (index + 1) * SPLITMIX_GAMMA;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return x + (int) (((z >> 32) * (uint64_t) (y - x + 1)) >> 32);
+}
+
+bool SaveDataset(const char* path, int size) {
+    DatasetHeader header;
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+    header.count = size;
+    header.generator = gGenerator;
+    header.seed = RANDOM_SEED;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(gData, sizeof(int), size, file) != (size_t) size) {
+        perror(path);
+        fclose(file);
+        return false;
+    }
+
+    return fclose(file) == 0;
+}
+
+// Map the file copy-on-write, so placing the zero never touches the file, and point gData past the header.
+// The mapping stays for the life of the process
+bool LoadDataset(const char* path, int size) {
+    struct stat st;
+    DatasetHeader* header;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        return false;
+    }
+
+    if ((size_t) st.st_size < sizeof(DatasetHeader)) {
+        fprintf(stderr, "%s is not a dataset file\n", path);
+        close(fd);
+        return false;
+    }
+
+    header = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+
+    if (memcmp(header->magic, DATASET_MAGIC, sizeof(header->magic)) != 0 ||
+        (size_t) st.st_size < sizeof(DatasetHeader) + header->count * sizeof(int)) {
+        fprintf(stderr, "%s is not a dataset file\n", path);
+        munmap(header, st.st_size);
+        return false;
+    }
+    if (header->count < size) {
+        fprintf(stderr, "%s only holds %ld elements\n", path, header->count);
+        munmap(header, st.st_size);
+        return false;
+    }
+
+    gData = (int*) (header + 1);
+    return true;
+}
+
+// Benchmark mode: for every array size and thread count, run each phase -warmup times untimed and -trials
+// times timed, and print one CSV or JSON record per phase with the median, minimum, mean and standard
+// deviation in nanoseconds and the speedup of the median over the sequential median. The sequential phase
+// is measured once per size. The input is generated once, for the largest size, and shared by all sizes
+int RunBenchmark(int argc, char* argv[]) {
+    long sizes[32], threads[MAX_THREADS];
+    int sizeCount = ParseList("100000,1000000,10000000", sizes, 32);
+    int threadCounts = ParseList("1,2,4,8,16", threads, MAX_THREADS);
+    bool modeEnabled[PHASE_COUNT];
+    int warmup = 2, trials = 10, indices[MAX_THREADS][3];
+    long zeroIndex = -1, maxSize = 0;
+    bool json = false, firstRecord = true;
+    const char* kernelName = "auto";
+    ReduceSchedule schedule = REDUCE_DYNAMIC;
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        modeEnabled[p] = true;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Invalid option %s\nUsage: " BENCH_USAGE, argv[i]);
+            return -1;
+        }
+        if (strcmp(argv[i], "-sizes") == 0) {
+            sizeCount = ParseList(argv[++i], sizes, 32);
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            threadCounts = ParseList(argv[++i], threads, MAX_THREADS);
+        } else if (strcmp(argv[i], "-modes") == 0) {
+            char list[256];
+            strncpy(list, argv[++i], sizeof(list) - 1);
+            list[sizeof(list) - 1] = '\0';
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                modeEnabled[p] = p == PHASE_SEQUENTIAL; //Always measured, it is the speedup baseline
+            }
+            for (char* mode = strtok(list, ","); mode != NULL; mode = strtok(NULL, ",")) {
+                int p;
+                for (p = 0; p < PHASE_COUNT && strcmp(mode, gPhases[p].name) != 0; p++);
+                if (p == PHASE_COUNT) {
+                    fprintf(stderr, "Unknown mode %s\n", mode);
+                    return -1;
+                }
+                modeEnabled[p] = true;
+            }
+        } else if (strcmp(argv[i], "-warmup") == 0) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-trials") == 0) {
+            trials = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-zero") == 0) {
+            zeroIndex = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-format") == 0 && strcmp(argv[i + 1], "csv") == 0) {
+            json = false;
+            i++;
+        } else if (strcmp(argv[i], "-format") == 0 && strcmp(argv[i + 1], "json") == 0) {
+            json = true;
+            i++;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            kernelName = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && strcmp(argv[i + 1], "static") == 0) {
+            schedule = REDUCE_STATIC;
+            i++;
+        } else if (strcmp(argv[i], "-s") == 0 && strcmp(argv[i + 1], "dynamic") == 0) {
+            schedule = REDUCE_DYNAMIC;
+            i++;
+        } else if (strcmp(argv[i], "-g") == 0 && strcmp(argv[i + 1], "splitmix") == 0) {
+            gGenerator = GEN_SPLITMIX;
+            i++;
+        } else if (strcmp(argv[i], "-g") == 0 && strcmp(argv[i + 1], "legacy") == 0) {
+            gGenerator = GEN_LEGACY;
+            i++;
+        } else if (strcmp(argv[i], "-e") == 0 && strcmp(argv[i + 1], "auto") == 0) {
+            gEngineChoice = ENGINE_AUTO;
+            i++;
+        } else if (strcmp(argv[i], "-e") == 0 && strcmp(argv[i + 1], "multiply") == 0) {
+            gEngineChoice = ENGINE_MULTIPLY;
+            i++;
+        } else if (strcmp(argv[i], "-e") == 0 && strcmp(argv[i + 1], "histogram") == 0) {
+            gEngineChoice = ENGINE_HISTOGRAM;
+            i++;
+        } else {
+            fprintf(stderr, "Invalid option %s %s\nUsage: " BENCH_USAGE, argv[i], argv[i + 1]);
+            return -1;
+        }
+    }
+
+    if (sizeCount == 0 || threadCounts == 0 || trials <= 0 || warmup < 0) {
+        fprintf(stderr, "Invalid benchmark parameters\n");
+        return -1;
+    }
+    for (int i = 0; i < sizeCount; i++) {
+        if (sizes[i] <= 0 || sizes[i] > MAX_SIZE) {
+            fprintf(stderr, "Invalid Array Size\n");
+            return -1;
+        }
+        maxSize = sizes[i] > maxSize ? sizes[i] : maxSize;
+    }
+    for (int i = 0; i < threadCounts; i++) {
+        if (threads[i] <= 0 || threads[i] > MAX_THREADS) {
+            fprintf(stderr, "Invalid Thread Count\n");
+            return -1;
+        }
+    }
+    if (!SelectProdKernel(kernelName)) {
+        fprintf(stderr, "Product kernel %s is not available on this CPU\n", kernelName);
+        return -1;
+    }
+
+    long* samples = malloc(trials * sizeof(long));
+    if ((gData = AllocateData(maxSize)) == NULL || samples == NULL) {
+        fprintf(stderr, "Error: cannot allocate %ld elements\n", maxSize);
+        return -1;
+    }
+    gThreadCount = threads[threadCounts - 1];
+    CalculateIndices(maxSize, gThreadCount, indices);
+    GenerateInput(maxSize, indices);
+    if (zeroIndex >= 0 && zeroIndex < maxSize) {
+        gData[zeroIndex] = 0;
+    }
+    fprintf(stderr, "Benchmarking with the %s product kernel, %d warm-up and %d timed runs per point\n",
+            gProdKernelName, warmup, trials);
+
+    if (json) {
+        printf("[\n");
+    } else {
+        printf("mode,kernel,size,threads,trials,median_ns,min_ns,mean_ns,stddev_ns,speedup,product\n");
+    }
+
+    for (int s = 0; s < sizeCount; s++) {
+        double sequentialMedian = 0;
+        int sequentialProd = 0;
+
+        for (int t = 0; t < threadCounts; t++) {
+            gThreadCount = threads[t];
+            CalculateIndices(sizes[s], gThreadCount, indices);
+            SetupEngine(schedule);
+
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                // The sequential baseline only depends on the size
+                if (!modeEnabled[p] || (p == PHASE_SEQUENTIAL && t > 0) ||
+                    (p == PHASE_HISTOGRAM && !UseHistogramEngine(sizes[s], gThreadCount))) {
+                    continue;
+                }
+
+                int prod = 0;
+                for (int run = 0; run < warmup + trials; run++) {
+                    long startNs = GetNanoTime();
+                    prod = gPhases[p].run(sizes[s], indices);
+                    if (run >= warmup) {
+                        samples[run - warmup] = gResultNs - startNs;
+                    }
+                }
+
+                double mean = 0, variance = 0;
+                for (int i = 0; i < trials; i++) {
+                    mean += samples[i];
+                }
+                mean /= trials;
+                for (int i = 0; i < trials; i++) {
+                    variance += (samples[i] - mean) * (samples[i] - mean);
+                }
+                qsort(samples, trials, sizeof(long), CompareLong);
+                double median = (trials % 2) ? samples[trials / 2] : (samples[trials / 2 - 1] + samples[trials / 2]) / 2.0;
+                double stddev = trials > 1 ? sqrt(variance / (trials - 1)) : 0.0;
+                if (p == PHASE_SEQUENTIAL) {
+                    sequentialMedian = median;
+                    sequentialProd = prod;
+                } else if (p == PHASE_HISTOGRAM && prod != sequentialProd) {
+                    fprintf(stderr, "Error: histogram product %d does not match sequential product %d\n", prod, sequentialProd);
+                    return -1;
+                }
+                double speedup = median > 0 ? sequentialMedian / median : 0.0;
+                int threadColumn = p == PHASE_SEQUENTIAL ? 1 : gThreadCount;
+
+                if (json) {
+                    printf("%s  {\"mode\": \"%s\", \"kernel\": \"%s\", \"size\": %ld, \"threads\": %d, \"trials\": %d, "
+                           "\"median_ns\": %.0f, \"min_ns\": %ld, \"mean_ns\": %.0f, \"stddev_ns\": %.0f, \"speedup\": %.3f, \"product\": %d}",
+                           firstRecord ? "" : ",\n", gPhases[p].name, gProdKernelName, sizes[s], threadColumn, trials,
+                           median, samples[0], mean, stddev, speedup, prod);
+                } else {
+                    printf("%s,%s,%ld,%d,%d,%.0f,%ld,%.0f,%.0f,%.3f,%d\n", gPhases[p].name, gProdKernelName, sizes[s],
+                           threadColumn, trials, median, samples[0], mean, stddev, speedup, prod);
+                }
+                firstRecord = false;
+                fflush(stdout);
+            }
+
+            ReduceEngineDestroy(gEngine);
+        }
+    }
+
+    if (json) {
+        printf("\n]\n");
+    }
+    free(samples);
+    return 0;
+}
+
+int ParseList(const char* list, long* values, int max) {
+    int count = 0;
+    const char* p = list;
+
+    while (*p != '\0' && count < max) {
+        char* end;
+        values[count++] = strtol(p, &end, 10);
+        if (end == p) {
+            return 0;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    return count;
+}
+
+int CompareLong(const void* a, const void* b) {
+    long x = *(const long*) a, y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+// Streaming mode: the reader thread fills a ring of STREAM_BUFFERS buffers while the parent reduces the
+// previous one on the reduce engine, so I/O overlaps the threaded reduction and memory stays at
+// STREAM_BUFFERS * gStreamChunk elements however large the input is. The input is a dataset file written
+// with -save, or raw native-endian 32-bit ints, from a file or from stdin ("-"). Any int is accepted: the
+// reader reduces each one mod NUM_LIMIT, since the kernels only hold for factors that keep acc * x in 32 bits
+int RunStreamMode(const char* path, ReduceSchedule schedule) {
+    pthread_t reader;
+    ReduceEngine* engine;
+    ReduceSpec spec;
+    ReduceStats stats;
+    long long total = 0; //Elements reduced, 64-bit so inputs past 2^31 elements are fine
+    long waitNs = 0; //Time the parent spent waiting on the reader
+    int prod = 1, partProd, one = 1, zero = 0;
+    int slot = 0;
+
+    if (strcmp(path, "-") == 0) {
+        gStreamFd = STDIN_FILENO;
+    } else if ((gStreamFd = open(path, O_RDONLY)) < 0) {
+        perror(path);
+        return -1;
+    } else {
+        posix_fadvise(gStreamFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    for (int i = 0; i < STREAM_BUFFERS; i++) {
+        gStreamBuffers[i].data = malloc(gStreamChunk * sizeof(int));
+        if (gStreamBuffers[i].data == NULL) {
+            fprintf(stderr, "Error: cannot allocate streaming buffers\n");
+            return -1;
+        }
+        gStreamBuffers[i].full = false;
+        gStreamBuffers[i].eof = false;
+    }
+
+    engine = ReduceEngineCreate(gThreadCount);
+    ReduceSpecInit(&spec, REDUCE_CUSTOM, REDUCE_INT32, NULL, 0);
+    spec.elemSize = sizeof(int);
+    spec.accSize = sizeof(int);
+    spec.identity = &one;
+    spec.absorbing = &zero;
+    spec.reduceRange = FoldProd;
+    spec.combine = CombineProd;
+    spec.schedule = schedule;
+
+    gStreamStop = false;
+    long startNs = GetNanoTime();
+    pthread_create(&reader, NULL, ThStreamReader, NULL);
+
+    for (;;) {
+        StreamBuffer* buffer = &gStreamBuffers[slot];
+        long waitStart = GetNanoTime();
+
+        pthread_mutex_lock(&gStreamLock);
+        while (!buffer->full) {
+            pthread_cond_wait(&gStreamCond, &gStreamLock);
+        }
+        pthread_mutex_unlock(&gStreamLock);
+        waitNs += GetNanoTime() - waitStart;
+
+        if (buffer->count > 0) {
+            spec.data = buffer->data;
+            spec.count = buffer->count;
+            ParallelReduce(engine, &spec, &partProd, &stats);
+            prod = (prod * partProd) % NUM_LIMIT;
+            total += buffer->count;
+        }
+
+        bool last = buffer->eof || prod == 0;
+
+        pthread_mutex_lock(&gStreamLock);
+        buffer->full = false;
+        if (prod == 0) {
+            gStreamStop = true;
+        }
+        pthread_cond_broadcast(&gStreamCond);
+        pthread_mutex_unlock(&gStreamLock);
+
+        if (last) {
+            break;
+        }
+        slot = (slot + 1) % STREAM_BUFFERS;
+    }
+
+    pthread_join(reader, NULL);
+    long ns = GetNanoTime() - startNs;
+
+    printf("Streamed multiplication of %lld elements (%.1f MiB) completed in %.3f ms (%.1f MiB/s, %.3f ms waiting on input). Product = %d\n",
+           total, total * sizeof(int) / 1048576.0, ns / 1e6, ns > 0 ? total * sizeof(int) / 1048576.0 * 1e9 / ns : 0.0, waitNs / 1e6, prod);
+    if (prod == 0) {
+        printf("    Stopped reading at the first zero\n");
+    }
+
+    ReduceEngineDestroy(engine);
+    for (int i = 0; i < STREAM_BUFFERS; i++) {
+        free(gStreamBuffers[i].data);
+    }
+    if (gStreamFd != STDIN_FILENO) {
+        close(gStreamFd);
+    }
+    return 0;
+}
+
+void* ThStreamReader(void* param) {
+    long bytes = gStreamChunk * sizeof(int);
+    bool first = true;
+    int slot = 0;
+
+    for (;;) {
+        StreamBuffer* buffer = &gStreamBuffers[slot];
+
+        pthread_mutex_lock(&gStreamLock);
+        while (buffer->full && !gStreamStop) {
+            pthread_cond_wait(&gStreamCond, &gStreamLock);
+        }
+        pthread_mutex_unlock(&gStreamLock);
+        if (gStreamStop) {
+            return NULL;
+        }
+
+        char* dest = (char*) buffer->data;
+        long got = ReadFully(gStreamFd, dest, bytes);
+
+        // Drop the header of a dataset file so the same files work for -load and -stream
+        if (first && got >= (long) sizeof(DatasetHeader) && memcmp(dest, DATASET_MAGIC, 8) == 0) {
+            memmove(dest, dest + sizeof(DatasetHeader), got - sizeof(DatasetHeader));
+            got -= sizeof(DatasetHeader);
+            got += ReadFully(gStreamFd, dest + got, bytes - got);
+        }
+        first = false;
+        if (gStreamStop) {
+            return NULL;
+        }
+
+        if (got % sizeof(int) != 0) {
+            fprintf(stderr, "Ignoring %ld trailing bytes that do not make a whole element\n", got % (long) sizeof(int));
+        }
+
+        // Bring every element into [0, NUM_LIMIT) in 64 bits; negative values reduce to their residue too
+        int* values = buffer->data;
+        for (long i = 0; i < got / (long) sizeof(int); i++) {
+            if ((unsigned) values[i] >= NUM_LIMIT) {
+                values[i] = (int) (((long long) values[i] % NUM_LIMIT + NUM_LIMIT) % NUM_LIMIT);
+            }
+        }
+
+        pthread_mutex_lock(&gStreamLock);
+        buffer->count = got / sizeof(int);
+        buffer->eof = got < bytes;
+        buffer->full = true;
+        pthread_cond_broadcast(&gStreamCond);
+        pthread_mutex_unlock(&gStreamLock);
+
+        if (got < bytes) {
+            return NULL;
+        }
+        slot = (slot + 1) % STREAM_BUFFERS;
     }
 }
 
+long ReadFully(int fd, char* buf, long bytes) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    long got = 0;
+
+    // Wait for input in STREAM_POLL_MS slices, so a reader on a quiet pipe still notices gStreamStop
+    while (got < bytes && !gStreamStop) {
+        int ready = poll(&pfd, 1, STREAM_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        ssize_t n = read(fd, buf + got, bytes - got);
+        if (n < 0) {
+            perror("read");
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += n;
+    }
+
+    return got;
+}
+
 // Write a function that calculates the right indices to divide the array into thrdCnt equal divisions
 // For each division i, indices[i][0] should be set to the division number i,
 // indices[i][1] should be set to the start index, and indices[i][2] should be set to the end index
@@ -323,6 +1756,150 @@ void CalculateIndices(int arraySize, int thrdCnt, int indices[MAX_THREADS][3]) {
     }
 }
 
+// The scalar fallback: one multiply and one mod per element, stopping at the first zero
+int ProdKernelScalar(const int* data, int count) {
+    int prod = 1;
+
+    for (int i = 0; i < count; i++) {
+        if (data[i] == 0) {
+            return 0;
+        }
+        prod = (prod * data[i]) % NUM_LIMIT;
+    }
+
+    return prod;
+}
+
+#ifdef HAVE_X86_KERNELS
+// Reduce every 32-bit lane of x mod NUM_LIMIT. _mm256_mul_epu32 only multiplies the even lanes,
+// so the odd lanes are shifted down, reduced the same way and blended back in
+__attribute__((target("avx2")))
+static inline __m256i BarrettReduce256(__m256i x) {
+    const __m256i factor = _mm256_set1_epi64x(BARRETT_FACTOR);
+    const __m256i limit = _mm256_set1_epi32(NUM_LIMIT);
+    __m256i qEven = _mm256_srli_epi64(_mm256_mul_epu32(x, factor), BARRETT_SHIFT);
+    __m256i qOdd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), factor), BARRETT_SHIFT);
+    __m256i q = _mm256_blend_epi32(qEven, _mm256_slli_epi64(qOdd, 32), 0xAA);
+    __m256i r = _mm256_sub_epi32(x, _mm256_mullo_epi32(q, limit));
+    // r is in [0, 2 * NUM_LIMIT), so one conditional subtraction finishes the job
+    __m256i over = _mm256_cmpgt_epi32(r, _mm256_set1_epi32(NUM_LIMIT - 1));
+    return _mm256_sub_epi32(r, _mm256_and_si256(over, limit));
+}
+
+// Four accumulators of 8 lanes each, so 32 products are in flight instead of one dependent chain.
+// A zero element zeroes its lane for good (NUM_LIMIT is prime), so lanes are checked once per block
+__attribute__((target("avx2")))
+int ProdKernelAVX2(const int* data, int count) {
+    __m256i acc0 = _mm256_set1_epi32(1);
+    __m256i acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    int lanes[8];
+    int i = 0;
+
+    while (i + 32 <= count) {
+        int blockEnd = (count - i > KERNEL_BLOCK) ? i + KERNEL_BLOCK : count;
+
+        for (; i + 32 <= blockEnd; i += 32) {
+            acc0 = BarrettReduce256(_mm256_mullo_epi32(acc0, _mm256_loadu_si256((const __m256i*) &data[i])));
+            acc1 = BarrettReduce256(_mm256_mullo_epi32(acc1, _mm256_loadu_si256((const __m256i*) &data[i + 8])));
+            acc2 = BarrettReduce256(_mm256_mullo_epi32(acc2, _mm256_loadu_si256((const __m256i*) &data[i + 16])));
+            acc3 = BarrettReduce256(_mm256_mullo_epi32(acc3, _mm256_loadu_si256((const __m256i*) &data[i + 24])));
+        }
+
+        __m256i low = _mm256_min_epu32(_mm256_min_epu32(acc0, acc1), _mm256_min_epu32(acc2, acc3));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(low, _mm256_setzero_si256())) != 0) {
+            return 0;
+        }
+    }
+
+    // Combine the lanes, then finish the tail with the scalar kernel
+    acc0 = BarrettReduce256(_mm256_mullo_epi32(acc0, acc1));
+    acc2 = BarrettReduce256(_mm256_mullo_epi32(acc2, acc3));
+    acc0 = BarrettReduce256(_mm256_mullo_epi32(acc0, acc2));
+    _mm256_storeu_si256((__m256i*) lanes, acc0);
+
+    int prod = ProdKernelScalar(&data[i], count - i);
+    for (int j = 0; j < 8; j++) {
+        prod = (prod * lanes[j]) % NUM_LIMIT;
+    }
+
+    return prod;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i BarrettReduce512(__m512i x) {
+    const __m512i factor = _mm512_set1_epi64(BARRETT_FACTOR);
+    const __m512i limit = _mm512_set1_epi32(NUM_LIMIT);
+    __m512i qEven = _mm512_srli_epi64(_mm512_mul_epu32(x, factor), BARRETT_SHIFT);
+    __m512i qOdd = _mm512_srli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(x, 32), factor), BARRETT_SHIFT);
+    __m512i q = _mm512_mask_blend_epi32(0xAAAA, qEven, _mm512_slli_epi64(qOdd, 32));
+    __m512i r = _mm512_sub_epi32(x, _mm512_mullo_epi32(q, limit));
+    return _mm512_mask_sub_epi32(r, _mm512_cmpge_epu32_mask(r, limit), r, limit);
+}
+
+// Same scheme as ProdKernelAVX2 with four accumulators of 16 lanes each
+__attribute__((target("avx512f")))
+int ProdKernelAVX512(const int* data, int count) {
+    __m512i acc0 = _mm512_set1_epi32(1);
+    __m512i acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    int lanes[16];
+    int i = 0;
+
+    while (i + 64 <= count) {
+        int blockEnd = (count - i > KERNEL_BLOCK) ? i + KERNEL_BLOCK : count;
+
+        for (; i + 64 <= blockEnd; i += 64) {
+            acc0 = BarrettReduce512(_mm512_mullo_epi32(acc0, _mm512_loadu_si512(&data[i])));
+            acc1 = BarrettReduce512(_mm512_mullo_epi32(acc1, _mm512_loadu_si512(&data[i + 16])));
+            acc2 = BarrettReduce512(_mm512_mullo_epi32(acc2, _mm512_loadu_si512(&data[i + 32])));
+            acc3 = BarrettReduce512(_mm512_mullo_epi32(acc3, _mm512_loadu_si512(&data[i + 48])));
+        }
+
+        __m512i low = _mm512_min_epu32(_mm512_min_epu32(acc0, acc1), _mm512_min_epu32(acc2, acc3));
+        if (_mm512_cmpeq_epi32_mask(low, _mm512_setzero_si512()) != 0) {
+            return 0;
+        }
+    }
+
+    acc0 = BarrettReduce512(_mm512_mullo_epi32(acc0, acc1));
+    acc2 = BarrettReduce512(_mm512_mullo_epi32(acc2, acc3));
+    acc0 = BarrettReduce512(_mm512_mullo_epi32(acc0, acc2));
+    _mm512_storeu_si512(lanes, acc0);
+
+    int prod = ProdKernelScalar(&data[i], count - i);
+    for (int j = 0; j < 16; j++) {
+        prod = (prod * lanes[j]) % NUM_LIMIT;
+    }
+
+    return prod;
+}
+#endif
+
+// Pick the product kernel. "auto" takes the widest one the CPU supports, falling back to scalar
+bool SelectProdKernel(const char* name) {
+    bool isAuto = strcmp(name, "auto") == 0;
+
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if ((isAuto || strcmp(name, "avx512") == 0) && __builtin_cpu_supports("avx512f")) {
+        gProdKernel = ProdKernelAVX512;
+        gProdKernelName = "avx512";
+        return true;
+    }
+    if ((isAuto || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        gProdKernel = ProdKernelAVX2;
+        gProdKernelName = "avx2";
+        return true;
+    }
+#endif
+    if (isAuto || strcmp(name, "scalar") == 0) {
+        gProdKernel = ProdKernelScalar;
+        gProdKernelName = "scalar";
+        return true;
+    }
+
+    return false;
+}
+
 // Get a random number in the range [x, y]
 int GetRand(int x, int y) {
     int r = rand();
@@ -330,20 +1907,50 @@ int GetRand(int x, int y) {
     return r;
 }
 
-long GetMilliSecondTime(struct timeb timeBuf) {
-    long mliScndTime;
-    mliScndTime = timeBuf.time;
-    mliScndTime *= 1000;
-    mliScndTime += timeBuf.millitm;
-    return mliScndTime;
+// Report how much work early termination left behind: elements multiplied in chunks that finished after the
+// first zero was found, and, when the parent had its answer before joining, how long the children took to stop
+void PrintCancelStats(long drainNs) {
+    long wasted = 0;
+
+    if (!gCancelled) {
+        return;
+    }
+
+    for (int i = 0; i < gThreadCount; i++) {
+        wasted += gThreadResult[i].wasted;
+    }
+
+    if (drainNs < 0) {
+        printf("    Cancelled after the first zero: %ld elements multiplied after it was found\n", wasted);
+    } else {
+        printf("    Cancelled after the first zero: %ld elements multiplied after it was found, children stopped %.3f ms after the result\n",
+               wasted, drainNs / 1e6);
+    }
+}
+
+void PrintRunTime(const char* label, long ns, int runCount, int prod) {
+    if (runCount == 1) {
+        printf("%s completed in %.3f ms. Product = %d\n", label, ns / 1e6, prod);
+    } else {
+        printf("%s completed %d runs in %.3f ms (%.1f us per run). Product = %d\n",
+               label, runCount, ns / 1e6, ns / 1e3 / runCount, prod);
+    }
+}
+
+double GetThreadCpuMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+long GetNanoTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
 }
 
 long GetCurrentTime(void) {
-    long crntTime = 0;
-    struct timeb timeBuf;
-    ftime(&timeBuf);
-    crntTime = GetMilliSecondTime(timeBuf);
-    return crntTime;
+    return GetNanoTime() / 1000000;
 }
 
 void SetTime(void) {
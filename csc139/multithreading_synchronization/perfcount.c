@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfcount.h"
+
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} gEventConfig[PERF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int OpenEvent(int event, int groupFd) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = gEventConfig[event].type;
+    attr.config = gEventConfig[event].config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+    attr.exclude_kernel = 1;    // also keeps us under perf_event_paranoid 2
+    attr.exclude_hv = 1;
+
+    // pid 0, cpu -1: the calling thread, on whichever CPU it runs
+    return syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+// Probe once with a cycles counter on the calling thread. On failure *reason says why
+bool PerfAvailable(const char **reason) {
+    int fd = OpenEvent(PERF_CYCLES, -1);
+
+    if (fd >= 0) {
+        close(fd);
+        return true;
+    }
+
+    switch (errno) {
+    case ENOENT:
+    case EOPNOTSUPP:
+        *reason = "no hardware PMU is exposed (typical inside a VM or container)";
+        break;
+    case EACCES:
+    case EPERM:
+        *reason = "not permitted, see /proc/sys/kernel/perf_event_paranoid";
+        break;
+    case ENOSYS:
+        *reason = "the kernel has no perf_event_open";
+        break;
+    default:
+        *reason = strerror(errno);
+        break;
+    }
+    return false;
+}
+
+// Start counting for the calling thread. Events the CPU lacks are left at -1;
+// fails only when none of them could be opened
+bool PerfOpenThread(PerfCounters *counters) {
+    counters->leader = -1;
+
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        counters->fd[i] = OpenEvent(i, counters->leader);
+        if (counters->fd[i] >= 0 && counters->leader < 0) {
+            counters->leader = counters->fd[i];
+        }
+    }
+
+    if (counters->leader < 0) {
+        return false;
+    }
+
+    ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+// Any thread may read, the descriptors belong to the process
+void PerfRead(const PerfCounters *counters, PerfSample *sample) {
+    struct {
+        unsigned long long nr;
+        struct {
+            unsigned long long value;
+            unsigned long long id;
+        } values[PERF_EVENTS];
+    } group;
+    unsigned long long ids[PERF_EVENTS];
+
+    PerfSampleClear(sample);
+    if (counters->leader < 0 || read(counters->leader, &group, sizeof(group)) <= 0) {
+        return;
+    }
+
+    // Match values to events by id, since missing events shift the group order
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        ids[i] = 0;
+        if (counters->fd[i] >= 0) {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_ID, &ids[i]);
+        }
+    }
+    for (unsigned long long n = 0; n < group.nr && n < PERF_EVENTS; n++) {
+        for (int i = 0; i < PERF_EVENTS; i++) {
+            if (counters->fd[i] >= 0 && ids[i] == group.values[n].id) {
+                sample->value[i] = group.values[n].value;
+            }
+        }
+    }
+}
+
+void PerfClose(PerfCounters *counters) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (counters->fd[i] >= 0) {
+            close(counters->fd[i]);
+        }
+        counters->fd[i] = -1;
+    }
+    counters->leader = -1;
+}
+
+void PerfSampleClear(PerfSample *sample) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        sample->value[i] = -1;
+    }
+}
+
+void PerfSampleZero(PerfSample *sample) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        sample->value[i] = 0;
+    }
+}
+
+void PerfSampleAdd(PerfSample *total, const PerfSample *sample) {
+    PerfSample zero;
+
+    PerfSampleZero(&zero);
+    PerfSampleDelta(total, sample, &zero);
+}
+
+// Add end - start into total, leaving an event at -1 if it wasn't counted
+void PerfSampleDelta(PerfSample *total, const PerfSample *end, const PerfSample *start) {
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (end->value[i] < 0 || start->value[i] < 0) {
+            continue;
+        }
+        if (total->value[i] < 0) {
+            total->value[i] = 0;
+        }
+        total->value[i] += end->value[i] - start->value[i];
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef _PERFCOUNT_H
+#define _PERFCOUNT_H
+
+#include <stdbool.h>
+
+#define PERF_EVENTS 4           // cycles, instructions, LLC misses, branch misses
+
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_BRANCH_MISSES };
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// structures
+//
+// Counters for one thread, read as a single group so all four cover the same
+// interval. A descriptor of -1 is an event this CPU or VM doesn't expose
+typedef struct {
+    int fd[PERF_EVENTS];
+    int leader;                 // first open descriptor, the one the group is read through
+} PerfCounters;
+
+// Counts over some interval; -1 marks an event that couldn't be counted
+typedef struct {
+    long long value[PERF_EVENTS];
+} PerfSample;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// function prototypes
+//
+bool        PerfAvailable(const char **reason);
+bool        PerfOpenThread(PerfCounters *counters);
+void        PerfRead(const PerfCounters *counters, PerfSample *sample);
+void        PerfClose(PerfCounters *counters);
+void        PerfSampleClear(PerfSample *sample);
+void        PerfSampleZero(PerfSample *sample);
+void        PerfSampleAdd(PerfSample *total, const PerfSample *sample);
+void        PerfSampleDelta(PerfSample *total, const PerfSample *end, const PerfSample *start);
+
+#endif
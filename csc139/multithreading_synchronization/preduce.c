@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "preduce.h"
+
+// One worker's accumulator, alone on its cache lines
+typedef struct {
+    unsigned char acc[REDUCE_MAX_ACC];
+    long wasted;
+} __attribute__((aligned(CACHE_LINE_SIZE))) ReduceSlot;
+
+struct ReduceEngine {
+    ThreadPool *pool;
+    int threadCount;
+    ReduceSlot *slots;
+    const ReduceSpec *spec;             // the reduction currently running
+    volatile bool absorbed;             // raised by the first worker whose accumulator hits spec->absorbing
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// built-in operations
+//
+// Each DEFINE_FOLD/DEFINE_COMBINE pair handles one (op, element type) combination
+// with its own accumulator type, e.g. 32-bit sums accumulate in 64 bits
+#define DEFINE_FOLD(name, ElemType, AccType, STEP)                                          \
+    static void name(const void *base, long count, void *acc, const ReduceSpec *spec) {     \
+        const ElemType *p = (const ElemType *)base;                                         \
+        AccType a = *(AccType *)acc;                                                        \
+        (void)spec;                                                                         \
+        for (long i = 0; i < count; i++) {                                                  \
+            ElemType x = p[i];                                                              \
+            STEP;                                                                           \
+        }                                                                                   \
+        *(AccType *)acc = a;                                                                \
+    }
+
+#define DEFINE_COMBINE(name, AccType, STEP)                                                 \
+    static void name(void *acc, const void *other, const ReduceSpec *spec) {                \
+        AccType a = *(AccType *)acc;                                                        \
+        AccType x = *(const AccType *)other;                                                \
+        (void)spec;                                                                         \
+        STEP;                                                                               \
+        *(AccType *)acc = a;                                                                \
+    }
+
+DEFINE_FOLD(FoldSumInt32, int32_t, int64_t, a += x)
+DEFINE_FOLD(FoldMinInt32, int32_t, int32_t, a = x < a ? x : a)
+DEFINE_FOLD(FoldMaxInt32, int32_t, int32_t, a = x > a ? x : a)
+DEFINE_FOLD(FoldXorInt32, int32_t, int32_t, a ^= x)
+DEFINE_FOLD(FoldModProdInt32, int32_t, int64_t,
+            a = (a * (((int64_t)x % spec->modulus + spec->modulus) % spec->modulus)) % spec->modulus)
+
+DEFINE_FOLD(FoldSumInt64, int64_t, int64_t, a = (int64_t)((uint64_t)a + (uint64_t)x))
+DEFINE_FOLD(FoldMinInt64, int64_t, int64_t, a = x < a ? x : a)
+DEFINE_FOLD(FoldMaxInt64, int64_t, int64_t, a = x > a ? x : a)
+DEFINE_FOLD(FoldXorInt64, int64_t, int64_t, a ^= x)
+DEFINE_FOLD(FoldModProdInt64, int64_t, int64_t,
+            a = (int64_t)((__int128)a * ((x % spec->modulus + spec->modulus) % spec->modulus) % spec->modulus))
+
+DEFINE_FOLD(FoldSumDouble, double, double, a += x)
+DEFINE_FOLD(FoldMinDouble, double, double, a = x < a ? x : a)
+DEFINE_FOLD(FoldMaxDouble, double, double, a = x > a ? x : a)
+
+DEFINE_COMBINE(CombineSumInt64, int64_t, a = (int64_t)((uint64_t)a + (uint64_t)x))
+DEFINE_COMBINE(CombineMinInt32, int32_t, a = x < a ? x : a)
+DEFINE_COMBINE(CombineMaxInt32, int32_t, a = x > a ? x : a)
+DEFINE_COMBINE(CombineXorInt32, int32_t, a ^= x)
+DEFINE_COMBINE(CombineMinInt64, int64_t, a = x < a ? x : a)
+DEFINE_COMBINE(CombineMaxInt64, int64_t, a = x > a ? x : a)
+DEFINE_COMBINE(CombineXorInt64, int64_t, a ^= x)
+DEFINE_COMBINE(CombineModProd, int64_t, a = (int64_t)((__int128)a * x % spec->modulus))
+DEFINE_COMBINE(CombineSumDouble, double, a += x)
+DEFINE_COMBINE(CombineMinDouble, double, a = x < a ? x : a)
+DEFINE_COMBINE(CombineMaxDouble, double, a = x > a ? x : a)
+
+#define SET_BUILTIN(AccType, fold, comb, identityValue)                 \
+    do {                                                                \
+        spec->accSize = sizeof(AccType);                                \
+        spec->reduceRange = fold;                                       \
+        spec->combine = comb;                                           \
+        *(AccType *)spec->builtinIdentity = (identityValue);            \
+        spec->identity = spec->builtinIdentity;                         \
+    } while (0)
+
+#define SET_ABSORBING(AccType, absorbingValue)                          \
+    do {                                                                \
+        *(AccType *)spec->builtinAbsorbing = (absorbingValue);          \
+        spec->absorbing = spec->builtinAbsorbing;                       \
+    } while (0)
+
+// Fill in spec for one of the built-in operations over data[0..count-1].
+// For REDUCE_MODPROD set spec->modulus afterwards; for REDUCE_CUSTOM set the
+// callbacks, sizes and identity yourself. Returns -1 for an unsupported op/type pair
+int ReduceSpecInit(ReduceSpec *spec, ReduceOp op, ReduceType type, const void *data, long count) {
+    memset(spec, 0, sizeof(ReduceSpec));
+    spec->data = data;
+    spec->count = count;
+    spec->schedule = REDUCE_DYNAMIC;
+
+    if (op == REDUCE_CUSTOM) {
+        return 0;
+    }
+
+    switch (type) {
+        case REDUCE_INT32:
+            spec->elemSize = sizeof(int32_t);
+            switch (op) {
+                case REDUCE_SUM:
+                    SET_BUILTIN(int64_t, FoldSumInt32, CombineSumInt64, 0);
+                    return 0;
+                case REDUCE_MIN:
+                    SET_BUILTIN(int32_t, FoldMinInt32, CombineMinInt32, INT32_MAX);
+                    SET_ABSORBING(int32_t, INT32_MIN);
+                    return 0;
+                case REDUCE_MAX:
+                    SET_BUILTIN(int32_t, FoldMaxInt32, CombineMaxInt32, INT32_MIN);
+                    SET_ABSORBING(int32_t, INT32_MAX);
+                    return 0;
+                case REDUCE_XOR:
+                    SET_BUILTIN(int32_t, FoldXorInt32, CombineXorInt32, 0);
+                    return 0;
+                case REDUCE_MODPROD:
+                    SET_BUILTIN(int64_t, FoldModProdInt32, CombineModProd, 1);
+                    SET_ABSORBING(int64_t, 0);
+                    return 0;
+                default:
+                    return -1;
+            }
+        case REDUCE_INT64:
+            spec->elemSize = sizeof(int64_t);
+            switch (op) {
+                case REDUCE_SUM:
+                    SET_BUILTIN(int64_t, FoldSumInt64, CombineSumInt64, 0);
+                    return 0;
+                case REDUCE_MIN:
+                    SET_BUILTIN(int64_t, FoldMinInt64, CombineMinInt64, INT64_MAX);
+                    SET_ABSORBING(int64_t, INT64_MIN);
+                    return 0;
+                case REDUCE_MAX:
+                    SET_BUILTIN(int64_t, FoldMaxInt64, CombineMaxInt64, INT64_MIN);
+                    SET_ABSORBING(int64_t, INT64_MAX);
+                    return 0;
+                case REDUCE_XOR:
+                    SET_BUILTIN(int64_t, FoldXorInt64, CombineXorInt64, 0);
+                    return 0;
+                case REDUCE_MODPROD:
+                    SET_BUILTIN(int64_t, FoldModProdInt64, CombineModProd, 1);
+                    SET_ABSORBING(int64_t, 0);
+                    return 0;
+                default:
+                    return -1;
+            }
+        case REDUCE_DOUBLE:
+            spec->elemSize = sizeof(double);
+            switch (op) {
+                case REDUCE_SUM:
+                    SET_BUILTIN(double, FoldSumDouble, CombineSumDouble, 0.0);
+                    return 0;
+                case REDUCE_MIN:
+                    SET_BUILTIN(double, FoldMinDouble, CombineMinDouble, INFINITY);
+                    SET_ABSORBING(double, -INFINITY);
+                    return 0;
+                case REDUCE_MAX:
+                    SET_BUILTIN(double, FoldMaxDouble, CombineMaxDouble, -INFINITY);
+                    SET_ABSORBING(double, INFINITY);
+                    return 0;
+                default:
+                    return -1;
+            }
+    }
+
+    return -1;
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// engine
+//
+// Fold [start, end) into acc one REDUCE_CHECK_CHUNK at a time, stopping as soon as
+// any worker has reached the absorbing element. Returns false if it stopped early
+static bool FoldRange(ReduceEngine *engine, const ReduceSpec *spec, long start, long end, void *acc, long *wasted) {
+    const char *base = (const char *)spec->data;
+
+    for (long chunkStart = start; chunkStart < end; chunkStart += REDUCE_CHECK_CHUNK) {
+        if (engine->absorbed) {
+            return false;
+        }
+
+        long count = (end - chunkStart < REDUCE_CHECK_CHUNK) ? end - chunkStart : REDUCE_CHECK_CHUNK;
+        spec->reduceRange(base + chunkStart * spec->elemSize, count, acc, spec);
+
+        if (spec->absorbing && memcmp(acc, spec->absorbing, spec->accSize) == 0) {
+            engine->absorbed = true;
+            return false;
+        }
+        if (engine->absorbed) {
+            *wasted += count;
+        }
+    }
+
+    return true;
+}
+
+static void ReduceTask(void *arg, long start, long end, int workerId) {
+    ReduceEngine *engine = (ReduceEngine *)arg;
+    ReduceSlot *slot = &engine->slots[workerId];
+
+    FoldRange(engine, engine->spec, start, end, slot->acc, &slot->wasted);
+}
+
+ReduceEngine *ReduceEngineCreate(int threadCount) {
+    ReduceEngine *engine = calloc(1, sizeof(ReduceEngine));
+    if (!engine) {
+        return NULL;
+    }
+
+    engine->threadCount = threadCount;
+    engine->slots = aligned_alloc(CACHE_LINE_SIZE, threadCount * sizeof(ReduceSlot));
+    engine->pool = PoolCreate(threadCount);
+    if (!engine->slots || !engine->pool) {
+        fprintf(stderr, "Error: reduce engine allocation failed\n");
+        exit(-1);
+    }
+
+    return engine;
+}
+
+// Reduce spec->data into result (spec->accSize bytes). Small inputs run on the
+// calling thread; everything else is spread over the engine's thread pool with
+// one slice per worker (REDUCE_STATIC) or stealable ranges of spec->grain elements
+// (REDUCE_DYNAMIC). Returns -1 if the spec is unusable
+int ParallelReduce(ReduceEngine *engine, const ReduceSpec *spec, void *result, ReduceStats *stats) {
+    long wasted = 0;
+
+    if (!spec->reduceRange || !spec->combine || !spec->identity ||
+        spec->accSize == 0 || spec->accSize > REDUCE_MAX_ACC || spec->count < 0) {
+        return -1;
+    }
+
+    engine->spec = spec;
+    engine->absorbed = false;
+
+    if (spec->count < REDUCE_SERIAL_CUTOFF || engine->threadCount == 1) {
+        memcpy(result, spec->identity, spec->accSize);
+        FoldRange(engine, spec, 0, spec->count, result, &wasted);
+    } else {
+        long grain;
+        if (spec->schedule == REDUCE_STATIC) {
+            grain = spec->count / engine->threadCount + engine->threadCount;   // covers the last, larger slice
+        } else if (spec->grain > 0) {
+            grain = spec->grain;
+        } else {
+            grain = spec->count / ((long)engine->threadCount * 16);
+            grain = grain < REDUCE_MIN_GRAIN ? REDUCE_MIN_GRAIN : grain;
+        }
+
+        for (int i = 0; i < engine->threadCount; i++) {
+            memcpy(engine->slots[i].acc, spec->identity, spec->accSize);
+            engine->slots[i].wasted = 0;
+        }
+
+        PoolRun(engine->pool, ReduceTask, engine, 0, spec->count, grain);
+
+        memcpy(result, spec->identity, spec->accSize);
+        for (int i = 0; i < engine->threadCount; i++) {
+            spec->combine(result, engine->slots[i].acc, spec);
+            wasted += engine->slots[i].wasted;
+        }
+    }
+
+    // Workers that stopped early hold partial accumulators; the answer is the absorbing element
+    if (engine->absorbed) {
+        memcpy(result, spec->absorbing, spec->accSize);
+    }
+
+    if (stats) {
+        stats->absorbed = engine->absorbed;
+        stats->wasted = wasted;
+    }
+
+    return 0;
+}
+
+void ReduceEngineDestroy(ReduceEngine *engine) {
+    PoolDestroy(engine->pool);
+    free(engine->slots);
+    free(engine);
+}
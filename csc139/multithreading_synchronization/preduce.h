@@ -0,0 +1,76 @@
+#ifndef _PREDUCE_H
+#define _PREDUCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "threadpool.h"
+
+#define REDUCE_MAX_ACC 64               // Largest accumulator, in bytes, a reduction may use
+#define REDUCE_CHECK_CHUNK 65536        // Elements folded between checks for the absorbing element
+#define REDUCE_SERIAL_CUTOFF 32768      // Inputs smaller than this are reduced on the calling thread
+#define REDUCE_MIN_GRAIN 16384          // Smallest range a dynamic schedule hands out
+
+typedef enum {
+    REDUCE_SUM,
+    REDUCE_MIN,
+    REDUCE_MAX,
+    REDUCE_XOR,
+    REDUCE_MODPROD,                     // product mod spec->modulus; 0 is absorbing
+    REDUCE_CUSTOM                       // caller fills in reduceRange/combine/identity
+} ReduceOp;
+
+typedef enum {
+    REDUCE_INT32,
+    REDUCE_INT64,
+    REDUCE_DOUBLE                       // SUM, MIN and MAX only
+} ReduceType;
+
+typedef enum {
+    REDUCE_STATIC,                      // one equal contiguous slice per worker
+    REDUCE_DYNAMIC                      // small ranges split and stolen as workers free up
+} ReduceSchedule;
+
+typedef struct ReduceSpec ReduceSpec;
+
+// Fold count elements starting at base into *acc
+typedef void (*ReduceRangeFunc)(const void *base, long count, void *acc, const ReduceSpec *spec);
+// *acc = *acc combined with *other. Must be associative and commutative, since
+// workers combine ranges in whatever order they happen to run them
+typedef void (*ReduceCombineFunc)(void *acc, const void *other, const ReduceSpec *spec);
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// structures
+//
+struct ReduceSpec {
+    const void *data;                   // the buffer to reduce
+    long count;                         // number of elements in it
+    size_t elemSize;                    // bytes per element
+    size_t accSize;                     // bytes per accumulator, at most REDUCE_MAX_ACC
+    const void *identity;               // accumulator every worker starts from
+    const void *absorbing;              // optional: once an accumulator equals this, the answer is known
+    ReduceRangeFunc reduceRange;
+    ReduceCombineFunc combine;
+    long modulus;                       // REDUCE_MODPROD only
+    void *userData;                     // free for REDUCE_CUSTOM callbacks
+    ReduceSchedule schedule;
+    long grain;                         // REDUCE_DYNAMIC range size, 0 picks one from count and threads
+    unsigned char builtinIdentity[16];  // storage ReduceSpecInit points identity/absorbing at
+    unsigned char builtinAbsorbing[16];
+};
+
+typedef struct {
+    bool absorbed;                      // stopped early on the absorbing element
+    long wasted;                        // elements folded in chunks that finished after that
+} ReduceStats;
+
+typedef struct ReduceEngine ReduceEngine;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// function prototypes
+//
+int             ReduceSpecInit(ReduceSpec *spec, ReduceOp op, ReduceType type, const void *data, long count);
+ReduceEngine    *ReduceEngineCreate(int threadCount);
+int             ParallelReduce(ReduceEngine *engine, const ReduceSpec *spec, void *result, ReduceStats *stats);
+void            ReduceEngineDestroy(ReduceEngine *engine);
+
+#endif
@@ -0,0 +1,179 @@
+// Checks every built-in reduction of preduce.c against a serial loop, for both schedules and
+// 1, 2 and 4 threads, on an input below REDUCE_SERIAL_CUTOFF and on one well above it.
+//
+// build: make preduce_test (run by make test)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "preduce.h"
+
+#define LARGE_COUNT 1000003 //Odd, so slices and ranges don't divide it evenly
+#define SMALL_COUNT 1000 //Reduced on the calling thread
+#define MODULUS 9973
+
+int32_t* gInt32;
+int64_t* gInt64;
+double* gDouble;
+int gFailures = 0;
+
+uint64_t SplitMix(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+int64_t Mod(int64_t x) {
+    return (x % MODULUS + MODULUS) % MODULUS;
+}
+
+// What the reduction of the first count elements should give, as int64 or double
+void SerialInt(ReduceOp op, ReduceType type, long count, int64_t* expected) {
+    int64_t acc = op == REDUCE_MIN ? INT64_MAX : op == REDUCE_MAX ? INT64_MIN : op == REDUCE_MODPROD ? 1 : 0;
+
+    for (long i = 0; i < count; i++) {
+        int64_t x = type == REDUCE_INT32 ? gInt32[i] : gInt64[i];
+        switch (op) {
+            case REDUCE_SUM: acc = (int64_t) ((uint64_t) acc + (uint64_t) x); break;
+            case REDUCE_MIN: acc = x < acc ? x : acc; break;
+            case REDUCE_MAX: acc = x > acc ? x : acc; break;
+            case REDUCE_XOR: acc ^= x; break;
+            case REDUCE_MODPROD: acc = (int64_t) ((__int128) acc * Mod(x) % MODULUS); break;
+            default: break;
+        }
+    }
+    *expected = acc;
+}
+
+double SerialDouble(ReduceOp op, long count) {
+    double acc = op == REDUCE_MIN ? INFINITY : op == REDUCE_MAX ? -INFINITY : 0.0;
+
+    for (long i = 0; i < count; i++) {
+        double x = gDouble[i];
+        acc = op == REDUCE_SUM ? acc + x : op == REDUCE_MIN ? (x < acc ? x : acc) : (x > acc ? x : acc);
+    }
+    return acc;
+}
+
+// Run one reduction on the engine and compare it with the serial answer
+void Check(ReduceEngine* engine, int threads, ReduceSchedule schedule, ReduceOp op, ReduceType type,
+           const char* name, long count) {
+    static const char* typeNames[] = { "int32", "int64", "double" };
+    const void* data = type == REDUCE_INT32 ? (const void*) gInt32 : type == REDUCE_INT64 ? (const void*) gInt64 : (const void*) gDouble;
+    unsigned char result[REDUCE_MAX_ACC];
+    ReduceSpec spec;
+    ReduceStats stats;
+    bool ok;
+
+    ReduceSpecInit(&spec, op, type, data, count);
+    spec.modulus = MODULUS;
+    spec.schedule = schedule;
+    memset(result, 0, sizeof(result));
+    ParallelReduce(engine, &spec, result, &stats);
+
+    if (type == REDUCE_DOUBLE) {
+        double expected = SerialDouble(op, count), got;
+        memcpy(&got, result, sizeof(got));
+        // The parallel sum adds in a different order, so allow for rounding
+        ok = op == REDUCE_SUM ? fabs(got - expected) <= 1e-9 * fabs(expected) + 1e-9 : got == expected;
+        if (!ok) {
+            printf("FAIL  %-7s %-6s %-7s n=%-8ld t=%d: got %.17g, expected %.17g\n", name, typeNames[type],
+                   schedule == REDUCE_STATIC ? "static" : "dynamic", count, threads, got, expected);
+        }
+    } else {
+        int64_t expected, got;
+        SerialInt(op, type, count, &expected);
+        // 32-bit MIN, MAX and XOR accumulate in 32 bits, everything else in 64
+        if (type == REDUCE_INT32 && (op == REDUCE_MIN || op == REDUCE_MAX || op == REDUCE_XOR)) {
+            int32_t narrow;
+            memcpy(&narrow, result, sizeof(narrow));
+            got = narrow;
+        } else {
+            memcpy(&got, result, sizeof(got));
+        }
+        ok = got == expected;
+        if (!ok) {
+            printf("FAIL  %-7s %-6s %-7s n=%-8ld t=%d: got %lld, expected %lld\n", name, typeNames[type],
+                   schedule == REDUCE_STATIC ? "static" : "dynamic", count, threads, (long long) got, (long long) expected);
+        }
+    }
+
+    if (!ok) {
+        gFailures++;
+    }
+}
+
+int main(void) {
+    static const struct {
+        ReduceOp op;
+        const char* name;
+        bool hasDouble;
+    } ops[] = {
+        { REDUCE_SUM, "sum", true },
+        { REDUCE_MIN, "min", true },
+        { REDUCE_MAX, "max", true },
+        { REDUCE_XOR, "xor", false },
+        { REDUCE_MODPROD, "modprod", false },
+    };
+    static const int threadCounts[] = { 1, 2, 4 };
+    static const long counts[] = { SMALL_COUNT, LARGE_COUNT };
+    uint64_t rng = 139;
+    int checks = 0;
+
+    gInt32 = malloc(LARGE_COUNT * sizeof(int32_t));
+    gInt64 = malloc(LARGE_COUNT * sizeof(int64_t));
+    gDouble = malloc(LARGE_COUNT * sizeof(double));
+    if (gInt32 == NULL || gInt64 == NULL || gDouble == NULL) {
+        fprintf(stderr, "Error: cannot allocate the test input\n");
+        return 1;
+    }
+
+    // Full-range values, negative ones included, and no multiple of MODULUS so MODPROD isn't absorbed
+    for (long i = 0; i < LARGE_COUNT; i++) {
+        uint64_t r = SplitMix(&rng);
+        gInt32[i] = (int32_t) r;
+        gInt64[i] = (int64_t) SplitMix(&rng);
+        gDouble[i] = (double) (int32_t) r / 65536.0;
+        if (Mod(gInt32[i]) == 0) {
+            gInt32[i]++;
+        }
+        if (Mod(gInt64[i]) == 0) {
+            gInt64[i]++;
+        }
+    }
+
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+        ReduceEngine* engine = ReduceEngineCreate(threadCounts[t]);
+
+        for (int schedule = REDUCE_STATIC; schedule <= REDUCE_DYNAMIC; schedule++) {
+            for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+                for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+                    Check(engine, threadCounts[t], schedule, ops[o].op, REDUCE_INT32, ops[o].name, counts[c]);
+                    Check(engine, threadCounts[t], schedule, ops[o].op, REDUCE_INT64, ops[o].name, counts[c]);
+                    checks += 2;
+                    if (ops[o].hasDouble) {
+                        Check(engine, threadCounts[t], schedule, ops[o].op, REDUCE_DOUBLE, ops[o].name, counts[c]);
+                        checks++;
+                    }
+                }
+
+                // A zero near the end absorbs MODPROD, however early the workers give up
+                int32_t saved = gInt32[counts[c] - 7];
+                gInt32[counts[c] - 7] = 0;
+                Check(engine, threadCounts[t], schedule, REDUCE_MODPROD, REDUCE_INT32, "modprod", counts[c]);
+                gInt32[counts[c] - 7] = saved;
+                checks++;
+            }
+        }
+
+        ReduceEngineDestroy(engine);
+    }
+
+    printf("%s  %d of %d reductions match the serial loop\n", gFailures ? "FAIL" : "ok  ", checks - gFailures, checks);
+    free(gInt32);
+    free(gInt64);
+    free(gDouble);
+    return gFailures ? 1 : 0;
+}
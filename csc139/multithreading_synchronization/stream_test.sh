@@ -0,0 +1,59 @@
+#!/bin/sh
+# Streams 100k values in [1, 2^31) with no multiple of 9973, far past what the kernels can
+# multiply directly, through every kernel this CPU has, and checks the product against Python's.
+# Also checks that a zero followed by a pipe that stays open doesn't leave -stream waiting.
+#
+# usage: ./stream_test.sh [path to MTFindProd]
+BIN=${1:-./MTFindProd}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+status=0
+
+EXPECTED=$(python3 - "$DIR/input" <<'PY'
+import random, struct, sys
+random.seed(139)
+values = []
+while len(values) < 100000:
+    v = random.randrange(1, 2**31)
+    if v % 9973:
+        values.append(v)
+# a few negative values, which reduce to their residue
+values[10:13] = [-1, -9972, -(2**31)]
+with open(sys.argv[1], "wb") as f:
+    f.write(struct.pack("<%di" % len(values), *values))
+prod = 1
+for v in values:
+    prod = prod * v % 9973
+print(prod)
+PY
+)
+
+for kernel in scalar avx2 avx512; do
+    out=$("$BIN" -stream "$DIR/input" 4 -k $kernel -c 4096 2>&1)
+    case "$out" in
+    *"not available"*) echo "skip  $kernel"; continue ;;
+    esac
+    got=$(echo "$out" | sed -n 's/.*Product = \([0-9]*\).*/\1/p')
+    if [ "$got" = "$EXPECTED" ]; then
+        echo "ok    $kernel out-of-range product $got"
+    else
+        echo "FAIL  $kernel out-of-range product ${got:-none}, expected $EXPECTED"
+        status=1
+    fi
+done
+
+# A buffer of zeros, then a writer that keeps the pipe open: once the parent sees the zero, the
+# reader must stop waiting on the pipe rather than hold -stream until the writer goes away
+mkfifo "$DIR/pipe"
+(head -c 4096 /dev/zero; sleep 30) > "$DIR/pipe" &
+writer=$!
+out=$(timeout 10 "$BIN" -stream "$DIR/pipe" 2 -c 1024 2>&1)
+pkill -P $writer sleep
+if echo "$out" | grep -q "Product = 0"; then
+    echo "ok    stops reading a pipe at the first zero"
+else
+    echo "FAIL  kept waiting on a pipe after the first zero"
+    status=1
+fi
+
+exit $status
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+typedef struct {
+    ThreadPool *pool;
+    int id;
+} WorkerArg;
+
+struct ThreadPool {
+    int threadCount;
+    pthread_t *tids;
+    WorkerArg *workerArgs;
+    TaskDeque *deques;              // one per worker, each on its own cache lines
+
+    pthread_mutex_t lock;           // protects the two condition variables below
+    pthread_cond_t wake;            // idle workers park here waiting for a new generation
+    pthread_cond_t done;            // PoolRun parks here waiting for remaining to reach zero
+
+    RangeFunc func;                 // the current job; written before remaining is published
+    void *arg;
+    long grain;
+    int spinCount;                  // POOL_SPIN_COUNT, or 0 on a single CPU where spinning only delays the worker we wait on
+
+    atomic_long generation;         // bumped once per job
+    atomic_long remaining;          // elements of the current job that are not finished yet
+    atomic_bool shutdown;
+};
+
+static inline void CpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
+// owner side: push a range at the bottom, fails when the deque is full
+static bool PushBottom(TaskDeque *deque, RangeTask task) {
+    bool pushed = false;
+
+    pthread_spin_lock(&deque->lock);
+    if (deque->bottom - deque->top < DEQUE_CAPACITY) {
+        deque->tasks[deque->bottom % DEQUE_CAPACITY] = task;
+        __atomic_store_n(&deque->bottom, deque->bottom + 1, __ATOMIC_RELAXED);
+        pushed = true;
+    }
+    pthread_spin_unlock(&deque->lock);
+
+    return pushed;
+}
+
+// owner side: take the most recently pushed range
+static bool PopBottom(TaskDeque *deque, RangeTask *task) {
+    bool popped = false;
+
+    pthread_spin_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        __atomic_store_n(&deque->bottom, deque->bottom - 1, __ATOMIC_RELAXED);
+        *task = deque->tasks[deque->bottom % DEQUE_CAPACITY];
+        popped = true;
+    }
+    pthread_spin_unlock(&deque->lock);
+
+    return popped;
+}
+
+// thief side: take the oldest range, which is also the largest one
+static bool StealTop(TaskDeque *deque, RangeTask *task) {
+    bool stolen = false;
+
+    // racy peek so empty victims don't cost a lock
+    if (__atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) <= __atomic_load_n(&deque->top, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    pthread_spin_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        *task = deque->tasks[deque->top % DEQUE_CAPACITY];
+        __atomic_store_n(&deque->top, deque->top + 1, __ATOMIC_RELAXED);
+        stolen = true;
+    }
+    pthread_spin_unlock(&deque->lock);
+
+    return stolen;
+}
+
+// try every other worker once, starting with the right-hand neighbour
+static bool StealTask(ThreadPool *pool, int id, RangeTask *task) {
+    for (int i = 1; i < pool->threadCount; i++) {
+        if (StealTop(&pool->deques[(id + i) % pool->threadCount], task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Split the range in halves, leaving the upper halves for thieves, until it is
+// down to the grain size, then run it
+static void RunTask(ThreadPool *pool, int id, RangeTask task) {
+    while (task.end - task.start > pool->grain) {
+        long mid = task.start + (task.end - task.start) / 2;
+        RangeTask upper = { mid, task.end };
+
+        if (!PushBottom(&pool->deques[id], upper)) {
+            break;
+        }
+        task.end = mid;
+    }
+
+    pool->func(pool->arg, task.start, task.end, id);
+
+    long length = task.end - task.start;
+    if (atomic_fetch_sub_explicit(&pool->remaining, length, memory_order_acq_rel) == length) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void *PoolWorker(void *param) {
+    WorkerArg *self = (WorkerArg *)param;
+    ThreadPool *pool = self->pool;
+    long seen = 0;
+    RangeTask task;
+
+    for (;;) {
+        // Spin briefly so back-to-back jobs are picked up without a wakeup, then park
+        int spins = 0;
+        while (atomic_load_explicit(&pool->generation, memory_order_acquire) == seen &&
+               !atomic_load(&pool->shutdown)) {
+            if (++spins < pool->spinCount) {
+                CpuRelax();
+                continue;
+            }
+            pthread_mutex_lock(&pool->lock);
+            while (atomic_load(&pool->generation) == seen && !atomic_load(&pool->shutdown)) {
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        if (atomic_load(&pool->shutdown)) {
+            break;
+        }
+        seen = atomic_load_explicit(&pool->generation, memory_order_acquire);
+
+        // Nothing left to steal only means the last ranges are still running elsewhere
+        int misses = 0;
+        while (atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0) {
+            if (PopBottom(&pool->deques[self->id], &task) || StealTask(pool, self->id, &task)) {
+                RunTask(pool, self->id, task);
+                misses = 0;
+            } else if (++misses < pool->spinCount / 16) {
+                CpuRelax();
+            } else {
+                sched_yield();
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Start threadCount workers that live until PoolDestroy
+ThreadPool *PoolCreate(int threadCount) {
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->threadCount = threadCount;
+    pool->spinCount = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? POOL_SPIN_COUNT : 0;
+    pool->tids = calloc(threadCount, sizeof(pthread_t));
+    pool->workerArgs = calloc(threadCount, sizeof(WorkerArg));
+    pool->deques = aligned_alloc(CACHE_LINE_SIZE, threadCount * sizeof(TaskDeque));
+    if (!pool->tids || !pool->workerArgs || !pool->deques) {
+        fprintf(stderr, "Error: thread pool allocation failed\n");
+        exit(-1);
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_init(&pool->generation, 0);
+    atomic_init(&pool->remaining, 0);
+    atomic_init(&pool->shutdown, false);
+
+    for (int i = 0; i < threadCount; i++) {
+        pthread_spin_init(&pool->deques[i].lock, PTHREAD_PROCESS_PRIVATE);
+        pool->deques[i].top = 0;
+        pool->deques[i].bottom = 0;
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        pool->workerArgs[i].pool = pool;
+        pool->workerArgs[i].id = i;
+        pthread_create(&pool->tids[i], NULL, PoolWorker, &pool->workerArgs[i]);
+    }
+
+    return pool;
+}
+
+// Run func over [start, end) on the pool and return once every element is done.
+// Each worker is seeded with an equal slice; ranges above grain elements are split
+// on demand so idle workers can steal the rest
+void PoolRun(ThreadPool *pool, RangeFunc func, void *arg, long start, long end, long grain) {
+    if (end <= start) {
+        return;
+    }
+
+    pool->func = func;
+    pool->arg = arg;
+    pool->grain = grain > 0 ? grain : 1;
+    atomic_store_explicit(&pool->remaining, end - start, memory_order_release);
+
+    long slice = (end - start) / pool->threadCount;
+    for (int i = 0; i < pool->threadCount; i++) {
+        RangeTask task;
+        task.start = start + i * slice;
+        task.end = (i == pool->threadCount - 1) ? end : task.start + slice;
+        if (task.end > task.start) {
+            PushBottom(&pool->deques[i], task);
+        }
+    }
+
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int spins = 0; spins < pool->spinCount; spins++) {
+        if (atomic_load_explicit(&pool->remaining, memory_order_acquire) == 0) {
+            return;
+        }
+        CpuRelax();
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load_explicit(&pool->remaining, memory_order_acquire) != 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int PoolSize(ThreadPool *pool) {
+    return pool->threadCount;
+}
+
+void PoolDestroy(ThreadPool *pool) {
+    atomic_store(&pool->shutdown, true);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->tids[i], NULL);
+    }
+    for (int i = 0; i < pool->threadCount; i++) {
+        pthread_spin_destroy(&pool->deques[i].lock);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->deques);
+    free(pool->workerArgs);
+    free(pool->tids);
+    free(pool);
+}
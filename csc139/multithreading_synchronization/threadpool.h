@@ -0,0 +1,42 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define CACHE_LINE_SIZE 64
+#define DEQUE_CAPACITY 256      // Range tasks a single worker can hold before it stops splitting
+#define POOL_SPIN_COUNT 20000   // Polls of the job generation before an idle worker parks on the condvar
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// structures
+//
+// A half-open range of element indices [start, end)
+typedef struct {
+    long start;
+    long end;
+} RangeTask;
+
+// Work-stealing deque. The owning worker pushes and pops at the bottom,
+// thieves take the oldest (largest) ranges from the top
+typedef struct {
+    pthread_spinlock_t lock;
+    long top;
+    long bottom;
+    RangeTask tasks[DEQUE_CAPACITY];
+} __attribute__((aligned(CACHE_LINE_SIZE))) TaskDeque;
+
+// Called for every leaf range of a job; workerId is in [0, PoolSize())
+typedef void (*RangeFunc)(void *arg, long start, long end, int workerId);
+
+typedef struct ThreadPool ThreadPool;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// function prototypes
+//
+ThreadPool  *PoolCreate(int threadCount);
+void        PoolRun(ThreadPool *pool, RangeFunc func, void *arg, long start, long end, long grain);
+int         PoolSize(ThreadPool *pool);
+void        PoolDestroy(ThreadPool *pool);
+
+#endif
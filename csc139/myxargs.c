@@ -1,55 +1,501 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "memalloc/umem.h" // build: make myxargs
 
-#define MAX_INPUT_SIZE 1024
-#define MAX_ARGS 100
-#define MAX_COMMAND_LENGTH 256
+#define INITIAL_ARGS 16
+#define ARG_HEADROOM 2048 // bytes of ARG_MAX left unused, as GNU xargs does
+#define READ_BLOCK (1 << 20) // bytes read at a time with -0/-d
+#define ARENA_REGION (256 << 20) // bytes umem maps for the batch arena, touched only as used
+#define ARENA_CHUNK (4 << 20) // arena chunk, enough for a full ARG_MAX batch and its command line
+#define SLOWEST_JOBS 5 // jobs listed in the --joblog summary
+#define INITIAL_JOBS 16 // job slots to start with under -P 0
+#define CACHE_MAGIC "myxargs-cache " // start of a cache entry, then the exit status and key length
+#define CACHE_HEADER 30 // bytes in the fixed-width header line
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
 
+// a command that was started, kept until it is reaped (--joblog, --cache)
 typedef struct {
-    char *args[MAX_ARGS];
+    pid_t pid; // 0 for a free slot
+    int seq;
+    double start; // monotonic, for the wall time
+    double startEpoch; // wall clock, for the log
+    char *command;
+    int cacheFd; // entry being written, the command's stdout, -1 if none
+    long cacheData; // where the output starts in it
+    char *cacheTemp; // its name until it is complete
+    uint64_t cacheKey;
+} Job;
+
+// one of the slowest jobs so far
+typedef struct {
+    double wall;
+    int seq;
+    char *command;
+} SlowJob;
+
+// growable list of arguments
+typedef struct {
+    char **args;
     int count;
+    int capacity;
 } ArgsList;
 
 ArgsList commandArgs;
-int num = -1; // used for -n # command
+int num = -1; // used for -n # command, -1 packs as many as fit
+long maxChars = -1; // -s # command, longest command line in characters
+long maxBytes; // ARG_MAX minus the environment, for strings and pointers together
+int delimiter = -1; // -0 / -d delim command, -1 splits on whitespace
+ArgsList retainedBlocks; // -0/-d input blocks the current batch points into
+long baseChars, baseBytes; // what the command itself takes of the limits
+long batchChars, batchBytes; // and the batch so far
+uarena_t batchArena; // every string built for the current batch; reset once it has run
+ArgsList finalCommand; // the command line of the current batch, reused batch to batch
 char *replaceIcommand = NULL; // -I {} command
 bool rCommand = false; // -r command
 bool tCommand = false; // -t command
+int maxProcs = 1; // -P # command, commands allowed to run at once, 0 for no limit
+int runningProcs = 0; // commands started and not reaped yet
+int exitStatus = 0; // what myxargs exits with, aggregated like GNU xargs
+bool aborting = false; // a command exited 255 or was killed: run nothing more
+FILE *jobLog = NULL; // --joblog file command, one line per finished job
+Job *jobs; // a slot for each running command
+int jobSlots; // maxProcs, or as many as -P 0 has needed so far
+int jobsStarted = 0, jobsDone = 0;
+double runStart; // when myxargs started, for the throughput
+double totalWall, totalUser, totalSys; // summed over every finished job
+long peakRss; // largest max RSS of any job, in KB
+SlowJob slowest[SLOWEST_JOBS]; // longest wall times, slowest first
+char *cacheDir = NULL; // --cache dir command, results of earlier runs
+int cacheHits = 0, cacheMisses = 0;
+
+extern char **environ;
 
 void errorUsage() {
-    printf("Usage: myxargs [-n num] [-I replace] [-t] [-r] command\n");
+    printf("Usage: myxargs [-n num] [-s max-chars] [-0 | -d delim] [-I replace] [-P procs] [-t] [-r] [--joblog file] [--cache dir] command\n");
+    printf("       -P 0 runs as many commands at once as it can\n");
     exit(EXIT_FAILURE);
 }
 
-// sanitize special characters
-char *sanitizeInput(char *input) {
-    static char sanitized[MAX_INPUT_SIZE];
-    int j = 0;
-    for (int i = 0; input[i] != '\0'; i++) {
-        if (strchr("; &|><*?()$", input[i]) == NULL) {
-            sanitized[j++] = input[i];
+// append an argument, growing the list as needed
+void addArg(ArgsList *list, char *arg) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : INITIAL_ARGS;
+        list->args = realloc(list->args, list->capacity * sizeof(char *));
+        if (list->args == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
         }
     }
-    sanitized[j] = '\0';
-    return sanitized;
+    list->args[list->count++] = arg;
 }
 
-// get input from stdin
-void readInput(ArgsList *inputs) {
-    char line[MAX_INPUT_SIZE];
-    while (fgets(line, sizeof(line), stdin)) {
-        char *token = strtok(line, " \t\n");
-        while (token != NULL) {
-            char *sanitized = sanitizeInput(token);
-            inputs->args[inputs->count++] = strdup(sanitized);
-            token = strtok(NULL, " \t\n");
+// allocate from the batch arena
+void *arenaAlloc(size_t size) {
+    void *ptr = uarenaalloc(&batchArena, size);
+    if (ptr == NULL) {
+        fprintf(stderr, "myxargs: out of arena memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+char *arenaStrdup(const char *str) {
+    size_t size = strlen(str) + 1;
+    return memcpy(arenaAlloc(size), str, size);
+}
+
+// free the strings in the list and empty it, keeping its storage for reuse
+void clearArgs(ArgsList *list) {
+    for (int i = 0; i < list->count; i++) {
+        free(list->args[i]);
+    }
+    list->count = 0;
+}
+
+// fold one child's wait status into exitStatus the way GNU xargs does:
+// 123 if any command exited non-zero. A command that exits 255 or is killed
+// by a signal stops myxargs: no more input is read and, once the running
+// commands finish, it exits 124 or 125. A command that can't be started
+// stops it the same way, with 126 or 127 (see runCommand)
+void recordStatus(int status) {
+    int code = 0;
+    const char *program = commandArgs.count > 0 ? commandArgs.args[0] : "command";
+    if (aborting) {
+        return;
+    }
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "myxargs: %s: terminated by signal %d\n", program, WTERMSIG(status));
+        exitStatus = 125;
+        aborting = true;
+        return;
+    } else if (WIFEXITED(status)) {
+        int exited = WEXITSTATUS(status);
+        if (exited == 255) {
+            fprintf(stderr, "myxargs: %s: exited with status 255; aborting\n", program);
+            exitStatus = 124;
+            aborting = true;
+            return;
+        } else if (exited != 0) {
+            code = 123;
+        }
+    }
+    if (code > exitStatus) {
+        exitStatus = code;
+    }
+}
+
+double monotonicTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double epochTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the command line as one string, for the job log
+char *joinCommand(ArgsList *finalCommand) {
+    size_t length = 1;
+    for (int i = 0; i < finalCommand->count; i++) {
+        length += strlen(finalCommand->args[i]) + 1;
+    }
+    char *command = malloc(length);
+    if (command == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char *out = command;
+    for (int i = 0; i < finalCommand->count; i++) {
+        size_t argLength = strlen(finalCommand->args[i]);
+        memcpy(out, finalCommand->args[i], argLength);
+        out += argLength;
+        *out++ = ' ';
+    }
+    if (out > command) {
+        out--; // drop the trailing space
+    }
+    *out = '\0';
+    return command;
+}
+
+// keep the job in the slowest list if it belongs there; takes the command
+void trackSlowest(double wall, int seq, char *command) {
+    int i = SLOWEST_JOBS;
+    while (i > 0 && (slowest[i - 1].command == NULL || slowest[i - 1].wall < wall)) {
+        i--;
+    }
+    if (i == SLOWEST_JOBS) {
+        free(command);
+        return;
+    }
+    free(slowest[SLOWEST_JOBS - 1].command);
+    memmove(&slowest[i + 1], &slowest[i], (SLOWEST_JOBS - 1 - i) * sizeof(SlowJob));
+    slowest[i] = (SlowJob) { wall, seq, command };
+}
+
+// write one line of the job log and add the job to the totals.
+// usage is NULL for a command that could not be started
+void logJob(Job *job, int status, struct rusage *usage) {
+    double wall = monotonicTime() - job->start;
+    double user = 0, sys = 0;
+    long rss = 0;
+    if (usage != NULL) {
+        user = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6;
+        sys = usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+        rss = usage->ru_maxrss;
+    }
+
+    fprintf(jobLog, "%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%ld\t%d\t%d\t%s\n", job->seq,
+            job->startEpoch, job->startEpoch + wall, wall, user, sys, rss,
+            WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+            WIFSIGNALED(status) ? WTERMSIG(status) : 0, job->command);
+
+    jobsDone++;
+    totalWall += wall;
+    totalUser += user;
+    totalSys += sys;
+    if (rss > peakRss) {
+        peakRss = rss;
+    }
+    trackSlowest(wall, job->seq, job->command);
+    job->command = NULL;
+}
+
+// free job slot for a command about to start. With -P N runCommand has
+// waited for one; with -P 0 the table doubles when every slot is taken
+Job *freeJob() {
+    for (int i = 0; i < jobSlots; i++) {
+        if (jobs[i].pid == 0) {
+            return &jobs[i];
+        }
+    }
+    jobs = realloc(jobs, jobSlots * 2 * sizeof(Job));
+    if (jobs == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(&jobs[jobSlots], 0, jobSlots * sizeof(Job));
+    jobSlots *= 2;
+    return &jobs[jobSlots / 2];
+}
+
+// totals and stragglers, printed to stderr when the job log is closed
+void printJobSummary() {
+    double elapsed = monotonicTime() - runStart;
+    fprintf(stderr, "myxargs: %d jobs in %.3f s, %.1f jobs/s\n", jobsDone, elapsed,
+            elapsed > 0 ? jobsDone / elapsed : 0.0);
+    if (jobsDone == 0) {
+        return;
+    }
+    fprintf(stderr, "myxargs: job wall %.3f s total, %.3f s mean; user %.3f s, sys %.3f s; peak RSS %ld KB\n",
+            totalWall, totalWall / jobsDone, totalUser, totalSys, peakRss);
+    fprintf(stderr, "myxargs: slowest jobs:\n");
+    for (int i = 0; i < SLOWEST_JOBS && slowest[i].command != NULL; i++) {
+        fprintf(stderr, "  #%-6d %10.3f s  %s\n", slowest[i].seq, slowest[i].wall, slowest[i].command);
+        free(slowest[i].command);
+        slowest[i].command = NULL;
+    }
+}
+
+// --cache
+// A command's result is stored under a 64-bit FNV-1a hash of the working
+// directory, the program that would run (found on PATH as posix_spawnp
+// would), the argument list, and the size, mtime and inode of the program and
+// of every argument that exists. So running elsewhere, rebuilding the tool or
+// finding another one first on PATH, touching or replacing an input file, or
+// adding to or removing from an argument directory misses. An entry is
+//   "myxargs-cache SSS LLLLLLLLLL\n" exit status, key length
+//   the arguments, each ending in '\0', to rule out hash collisions
+//   the command's stdout
+// Only commands that exit 0 are cached: stderr is not captured, so a failure
+// replayed from the cache would come back without its diagnostics
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// the file posix_spawnp would run for program, or program itself if it
+// isn't found, in which case the spawn fails and nothing is cached
+const char *resolveProgram(const char *program, char *path, size_t size) {
+    const char *dirs = getenv("PATH");
+    if (strchr(program, '/') != NULL || dirs == NULL) {
+        return program;
+    }
+    while (*dirs != '\0') {
+        size_t length = strcspn(dirs, ":");
+        // an empty PATH entry means the current directory
+        snprintf(path, size, "%.*s%s%s", (int) length, dirs, length ? "/" : "", program);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0) {
+            return path;
+        }
+        dirs += length + (dirs[length] == ':');
+    }
+    return program;
+}
+
+// size, mtime and inode of a file, if it exists
+uint64_t stampFile(uint64_t hash, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        long stamp[5] = { st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, st.st_ino, st.st_dev };
+        hash = fnv1a(hash, stamp, sizeof(stamp));
+    }
+    return hash;
+}
+
+uint64_t cacheKey(ArgsList *finalCommand) {
+    static char cwd[PATH_MAX] = "";
+    if (cwd[0] == '\0' && getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t hash = fnv1a(FNV_OFFSET, cwd, strlen(cwd) + 1);
+    if (finalCommand->count > 0) {
+        char path[PATH_MAX];
+        const char *program = resolveProgram(finalCommand->args[0], path, sizeof(path));
+        hash = fnv1a(hash, program, strlen(program) + 1);
+        hash = stampFile(hash, program);
+    }
+    for (int i = 0; i < finalCommand->count; i++) {
+        hash = fnv1a(hash, finalCommand->args[i], strlen(finalCommand->args[i]) + 1);
+        hash = stampFile(hash, finalCommand->args[i]);
+    }
+    return hash;
+}
+
+// copy the output part of an entry to our stdout
+void replayOutput(int fd, long offset) {
+    char buffer[65536];
+    ssize_t got;
+    fflush(stdout);
+    while ((got = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+        for (ssize_t done = 0, wrote; done < got; done += wrote) {
+            if ((wrote = write(STDOUT_FILENO, buffer + done, got - done)) < 0) {
+                perror("write");
+                exit(EXIT_FAILURE);
+            }
+        }
+        offset += got;
+    }
+}
+
+// look the command up; on a hit its output is written and its exit status returned
+int replayCached(ArgsList *finalCommand, uint64_t key) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%016llx", cacheDir, (unsigned long long) key);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    char header[CACHE_HEADER + 1] = "";
+    int status = -1;
+    long keyLength;
+    if (read(fd, header, CACHE_HEADER) == CACHE_HEADER &&
+        strncmp(header, CACHE_MAGIC, strlen(CACHE_MAGIC)) == 0 &&
+        sscanf(header + strlen(CACHE_MAGIC), "%d %ld", &status, &keyLength) == 2) {
+        // compare the stored arguments with ours, one at a time
+        long offset = CACHE_HEADER;
+        for (int i = 0; i < finalCommand->count && status >= 0; i++) {
+            size_t length = strlen(finalCommand->args[i]) + 1;
+            char *stored = arenaAlloc(length);
+            if (pread(fd, stored, length, offset) != (ssize_t) length ||
+                memcmp(stored, finalCommand->args[i], length) != 0) {
+                status = -1;
+            }
+            offset += length;
         }
+        if (status >= 0 && offset == CACHE_HEADER + keyLength) {
+            replayOutput(fd, offset);
+        } else {
+            status = -1;
+        }
+    } else {
+        status = -1;
+    }
+    close(fd);
+    return status;
+}
+
+// start a new entry for a command about to run: the header, with the status
+// left blank, and the key are written, and the command's stdout goes after them
+int startCacheEntry(Job *job, ArgsList *finalCommand) {
+    static int entries = 0;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%016llx.%d.%d.tmp", cacheDir,
+             (unsigned long long) job->cacheKey, (int) getpid(), entries++);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    long keyLength = 0;
+    for (int i = 0; i < finalCommand->count; i++) {
+        keyLength += strlen(finalCommand->args[i]) + 1;
+    }
+    dprintf(fd, "%s%3s %-*ld\n", CACHE_MAGIC, "", (int) (CACHE_HEADER - strlen(CACHE_MAGIC) - 5), keyLength);
+    for (int i = 0; i < finalCommand->count; i++) {
+        if (write(fd, finalCommand->args[i], strlen(finalCommand->args[i]) + 1) < 0) {
+            perror(path);
+        }
+    }
+
+    job->cacheFd = fd;
+    job->cacheData = CACHE_HEADER + keyLength;
+    job->cacheTemp = strdup(path);
+    return fd;
+}
+
+// close an entry, removing it unless it was renamed into place
+void dropCacheEntry(Job *job) {
+    if (job->cacheTemp[0] != '\0') {
+        unlink(job->cacheTemp);
+    }
+    close(job->cacheFd);
+    free(job->cacheTemp);
+    job->cacheFd = -1;
+    job->cacheTemp = NULL;
+}
+
+// the command has finished: pass its output on, and keep the entry if it
+// succeeded
+void finishCacheEntry(Job *job, int status) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%016llx", cacheDir, (unsigned long long) job->cacheKey);
+
+    replayOutput(job->cacheFd, job->cacheData);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        char code[4];
+        snprintf(code, sizeof(code), "%3d", WEXITSTATUS(status));
+        if (pwrite(job->cacheFd, code, 3, strlen(CACHE_MAGIC)) == 3 && rename(job->cacheTemp, path) == 0) {
+            job->cacheTemp[0] = '\0';
+        }
+    }
+    dropCacheEntry(job);
+}
+
+// wait for any one running command to finish
+// wait4 also returns the child's resource usage, for the job log
+void reapChild() {
+    int status;
+    struct rusage usage;
+    pid_t pid = wait4(-1, &status, 0, &usage);
+    if (pid > 0) {
+        runningProcs--;
+        recordStatus(status);
+        for (int i = 0; jobs != NULL && i < jobSlots; i++) {
+            if (jobs[i].pid == pid) {
+                if (jobs[i].cacheFd >= 0) {
+                    finishCacheEntry(&jobs[i], status);
+                }
+                if (jobLog != NULL) {
+                    logJob(&jobs[i], status, &usage);
+                }
+                jobs[i].pid = 0;
+                break;
+            }
+        }
+    }
+}
+
+// wait for every command still running
+void waitForAll() {
+    while (runningProcs > 0) {
+        reapChild();
     }
 }
 
 // run command with the arguments
+// the program is started directly with posix_spawnp, which searches PATH like
+// execvp and uses vfork, so there's no /bin/sh to start and no re-parsing of
+// the arguments. With -P more than one command can be running, and a new one
+// only waits for a free slot, not for the previous command.
+// With --cache a command that has run before isn't started at all; its
+// stored output and exit status are used instead. The output of a command
+// that does run is captured, so it appears all at once when it finishes
 void runCommand(ArgsList *finalCommand) {
     if (tCommand) {
         for (int i = 0; i < finalCommand->count; i++) {
@@ -58,89 +504,301 @@ void runCommand(ArgsList *finalCommand) {
         printf("\n");
     }
 
-    char command[MAX_COMMAND_LENGTH];
-    strcpy(command, finalCommand->args[0]);
-    for (int i = 1; i < finalCommand->count; i++) {
-        strcat(command, " ");
-        strcat(command, finalCommand->args[i]);
+    char **argv = arenaAlloc((finalCommand->count + 1) * sizeof(char *));
+    memcpy(argv, finalCommand->args, finalCommand->count * sizeof(char *));
+    argv[finalCommand->count] = NULL;
+
+    uint64_t key = 0;
+    if (cacheDir != NULL) {
+        key = cacheKey(finalCommand);
+        double start = monotonicTime(), startEpoch = epochTime();
+        int cached = replayCached(finalCommand, key);
+        if (cached >= 0) {
+            cacheHits++;
+            recordStatus(cached << 8);
+            if (jobLog != NULL) {
+                Job hit = { .seq = ++jobsStarted, .start = start, .startEpoch = startEpoch,
+                            .command = joinCommand(finalCommand), .cacheFd = -1 };
+                logJob(&hit, cached << 8, NULL);
+            }
+            return;
+        }
+        cacheMisses++;
     }
 
-    system(command);
-}
+    while (maxProcs > 0 && runningProcs >= maxProcs) {
+        reapChild();
+    }
+    if (aborting) {
+        return;
+    }
 
-// used for replacing the {} in I command
-void str_replace(char *str, const char *old, const char *new) {
-    char buffer[MAX_COMMAND_LENGTH];
-    char *p;
+    Job *job = NULL;
+    if (jobs != NULL) {
+        job = freeJob();
+        job->seq = ++jobsStarted;
+        job->command = jobLog != NULL ? joinCommand(finalCommand) : NULL;
+        job->cacheFd = -1;
+        job->cacheKey = key;
+        job->startEpoch = epochTime();
+        job->start = monotonicTime();
+    }
 
-    if (!(p = strstr(str, old))) {
-        return;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (cacheDir != NULL && startCacheEntry(job, finalCommand) >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, job->cacheFd, STDOUT_FILENO);
     }
 
-    strncpy(buffer, str, p - str);
-    buffer[p - str] = '\0';
-    sprintf(buffer + (p - str), "%s%s", new, p + strlen(old));
-    strcpy(str, buffer);
+    fflush(stdout); // keep -t output ahead of the command's own output
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    // out of processes, which -P 0 can get to: wait for one of ours and retry
+    while (err == EAGAIN && runningProcs > 0) {
+        reapChild();
+        err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        int status = (err == ENOENT ? 127 : 126) << 8; // as if a shell had exited with that code
+        fprintf(stderr, "myxargs: %s: %s\n", argv[0], strerror(err));
+        if (!aborting) {
+            exitStatus = WEXITSTATUS(status);
+            aborting = true;
+        }
+        if (job != NULL && job->cacheFd >= 0) {
+            dropCacheEntry(job);
+        }
+        if (jobLog != NULL) {
+            logJob(job, status, NULL);
+        }
+    } else {
+        runningProcs++;
+        if (job != NULL) {
+            job->pid = pid;
+        }
+    }
 }
 
-// -I command
-void withICommand(ArgsList *inputs) {
-    if (num == -1){
-        num = 1;
+// used for replacing the replace string in I command
+// returns a new string, from the batch arena, with every occurrence of old replaced
+char *str_replace(const char *str, const char *old, const char *new) {
+    size_t oldLen = strlen(old), newLen = strlen(new), count = 0;
+    const char *p;
+
+    for (p = strstr(str, old); p != NULL; p = strstr(p + oldLen, old)) {
+        count++;
     }
-    for (int i = 0; i < inputs->count; i += num) {
-        ArgsList batch;
-        batch.count = 0;
 
-        for (int j = i; j < i + num && j < inputs->count; j++) {
-            batch.args[batch.count++] = inputs->args[j];
-        }
+    char *result = arenaAlloc(strlen(str) + count * newLen - count * oldLen + 1);
+    char *out = result;
+    while ((p = strstr(str, old)) != NULL) {
+        memcpy(out, str, p - str);
+        out += p - str;
+        memcpy(out, new, newLen);
+        out += newLen;
+        str = p + oldLen;
+    }
+    strcpy(out, str);
+    return result;
+}
 
-        ArgsList finalCommand;
-        finalCommand.count = 0;
+// -I command
+// the command line only borrows strings: the command's own words from argv
+// and substituted words from the batch arena
+void withICommand(ArgsList *batch) {
+    finalCommand.count = 0;
 
-        for (int k = 0; k < commandArgs.count; k++) {
-            char *arg = commandArgs.args[k];
-            if (strstr(arg, "{}")) {
-                for (int l = 0; l < batch.count; l++) {
-                    finalCommand.args[finalCommand.count] = malloc(MAX_COMMAND_LENGTH);
-                    strcpy(finalCommand.args[finalCommand.count], arg);
-                    str_replace(finalCommand.args[finalCommand.count], "{}", batch.args[l]);
-                    finalCommand.count++;
-                }
-            } else {
-                finalCommand.args[finalCommand.count++] = strdup(arg);
+    for (int k = 0; k < commandArgs.count; k++) {
+        char *arg = commandArgs.args[k];
+        if (strstr(arg, replaceIcommand)) {
+            for (int l = 0; l < batch->count; l++) {
+                addArg(&finalCommand, str_replace(arg, replaceIcommand, batch->args[l]));
             }
+        } else {
+            addArg(&finalCommand, arg);
         }
-
-        runCommand(&finalCommand);
     }
+
+    runCommand(&finalCommand);
 }
 
 // if -I command is not passed
-void withoutICommand(ArgsList *inputs) {
-    if (num == -1){
-        num = 1;
+void withoutICommand(ArgsList *batch) {
+    finalCommand.count = 0;
+
+    for (int k = 0; k < commandArgs.count; k++) {
+        addArg(&finalCommand, commandArgs.args[k]);
+    }
+    for (int l = 0; l < batch->count; l++) {
+        addArg(&finalCommand, batch->args[l]);
+    }
+
+    runCommand(&finalCommand);
+}
+
+// run one batch of input arguments
+void runBatch(ArgsList *batch) {
+    if (replaceIcommand != NULL) {
+        withICommand(batch);
+    } else {
+        withoutICommand(batch);
     }
-    for (int i = 0; i < inputs->count; i += num) {
-        ArgsList batch;
-        batch.count = 0;
+}
 
-        for (int j = i; j < i + num && j < inputs->count; j++) {
-            batch.args[batch.count++] = inputs->args[j];
+// exec space left for arguments: sysconf(_SC_ARG_MAX) is shared by the
+// argument and environment strings and their pointers, so the environment
+// we pass on comes off the top
+long argumentSpace() {
+    long space = sysconf(_SC_ARG_MAX);
+    if (space <= 0) {
+        space = 131072; // the POSIX minimum is much lower, but every Linux allows this
+    }
+    for (char **env = environ; *env != NULL; env++) {
+        space -= strlen(*env) + 1 + sizeof(char *);
+    }
+    return space - ARG_HEADROOM;
+}
+
+// run the batch and empty it. Everything built for it came from the batch
+// arena, which is released in one step; -0/-d tokens point into
+// retainedBlocks instead, which go once nothing refers to them
+void flushBatch(ArgsList *batch) {
+    if (batch->count > 0 && !aborting) {
+        runBatch(batch);
+    }
+    batch->count = 0;
+    uarenareset(&batchArena);
+    clearArgs(&retainedBlocks);
+    batchChars = batchBytes = 0;
+}
+
+// add one input token to the batch
+// Without -n a batch is closed when the next token would push the command
+// line past -s characters or past the exec limit, so thousands of short
+// arguments go out in a handful of commands.
+// With copy the token is copied into the batch arena, which is only done
+// once the full batch has run and the arena has been reset for the next one
+void addInput(ArgsList *batch, char *token, bool copy) {
+    long tokenChars = strlen(token) + 1;
+    long tokenBytes = tokenChars + sizeof(char *);
+
+    // a token that can't fit even on its own ends the run, once the commands
+    // already started have finished
+    if (baseChars + tokenChars > maxChars || baseBytes + tokenBytes > maxBytes) {
+        fprintf(stderr, "myxargs: argument line too long\n");
+        exitStatus = 1;
+        aborting = true;
+        return;
+    }
+    if (batch->count > 0 && (baseChars + batchChars + tokenChars > maxChars ||
+                             baseBytes + batchBytes + tokenBytes > maxBytes)) {
+        flushBatch(batch);
+    }
+
+    if (copy) {
+        token = arenaStrdup(token);
+    }
+    addArg(batch, token);
+    batchChars += tokenChars;
+    batchBytes += tokenBytes;
+    if (batch->count == num) {
+        flushBatch(batch);
+    }
+}
+
+// get input from stdin
+// tokens are collected into a batch as they are read, and the batch runs as
+// soon as it is full, so the first command starts before stdin ends and only
+// one batch (plus the current line) is ever held in memory.
+// With -P the reader keeps going while earlier batches are still running.
+// Tokens are passed on as they are, as with -0/-d: commands are started
+// without a shell, so characters like ; & ( ) $ mean nothing special
+void readInput() {
+    ArgsList batch = { NULL, 0, 0 };
+    char *line = NULL;
+    size_t lineSize = 0;
+
+    while (!aborting && getline(&line, &lineSize, stdin) != -1) {
+        char *token = strtok(line, " \t\n");
+        while (token != NULL && !aborting) {
+            addInput(&batch, token, true);
+            token = strtok(NULL, " \t\n");
+        }
+    }
+
+    flushBatch(&batch);
+    free(batch.args);
+    free(line);
+}
+
+// get delimiter-separated input from stdin (-0 / -d)
+// input is read in large blocks and split with memchr; each delimiter is
+// overwritten with '\0' and the argument points straight into the block, so
+// tokens are never copied. A token cut off at the end of a block is moved to
+// the start of the next one, and a block stays allocated until the batch
+// that points into it has run
+void readDelimitedInput() {
+    ArgsList batch = { NULL, 0, 0 };
+    size_t capacity = READ_BLOCK;
+    char *block = malloc(capacity + 1); // +1 for the '\0' after a last, unterminated token
+    size_t length = 0, tokenStart = 0;
+    ssize_t got;
+
+    while (!aborting && block != NULL && (got = read(STDIN_FILENO, block + length, capacity - length)) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            exit(EXIT_FAILURE);
         }
+        size_t scanFrom = length;
+        length += got;
 
-        ArgsList finalCommand;
-        finalCommand.count = 0;
-        for (int k = 0; k < commandArgs.count; k++) {
-            finalCommand.args[finalCommand.count++] = strdup(commandArgs.args[k]);
+        char *end;
+        while (!aborting && (end = memchr(block + scanFrom, delimiter, length - scanFrom)) != NULL) {
+            *end = '\0';
+            addInput(&batch, block + tokenStart, false);
+            tokenStart = scanFrom = end - block + 1;
         }
-        for (int l = 0; l < batch.count; l++) {
-            finalCommand.args[finalCommand.count++] = strdup(batch.args[l]);
+
+        if (length < capacity) {
+            continue;
         }
 
-        runCommand(&finalCommand);
+        // The block is full: carry the partial token over to a new block,
+        // twice as large if that token alone filled this one
+        size_t partial = length - tokenStart;
+        size_t newCapacity = partial * 2 > READ_BLOCK ? partial * 2 : READ_BLOCK;
+        char *next = malloc(newCapacity + 1);
+        if (next == NULL) {
+            break;
+        }
+        memcpy(next, block + tokenStart, partial);
+        if (batch.count > 0) {
+            addArg(&retainedBlocks, block);
+        } else {
+            free(block);
+        }
+        block = next;
+        capacity = newCapacity;
+        length = partial;
+        tokenStart = 0;
+    }
+    if (block == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
     }
+
+    if (length > tokenStart) {
+        block[length] = '\0';
+        addInput(&batch, block + tokenStart, false);
+    }
+
+    flushBatch(&batch);
+    free(block);
+    free(batch.args);
 }
 
 // Driver
@@ -150,49 +808,128 @@ int main(int argc, char *argv[]) {
         errorUsage();
     }
 
-    commandArgs.count = 0;
-
     // go through arg list
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-n") == 0) {
-            if (i + 1 < argc) {
-                num = atoi(argv[++i]);
+            if (i + 1 < argc && (num = atoi(argv[++i])) > 0) {
+                continue;
+            }
+            errorUsage();
+        } else if (strcmp(argv[i], "-s") == 0) {
+            if (i + 1 < argc && (maxChars = atol(argv[++i])) > 0) {
+                continue;
+            }
+            errorUsage();
+        } else if (strcmp(argv[i], "-0") == 0) {
+            delimiter = '\0';
+        } else if (strcmp(argv[i], "-d") == 0) {
+            if (i + 1 >= argc) {
+                errorUsage();
+            }
+            char *delim = argv[++i];
+            if (strcmp(delim, "\\n") == 0) {
+                delimiter = '\n';
+            } else if (strcmp(delim, "\\t") == 0) {
+                delimiter = '\t';
+            } else if (strcmp(delim, "\\0") == 0) {
+                delimiter = '\0';
+            } else if (strlen(delim) == 1) {
+                delimiter = (unsigned char) delim[0];
             } else {
                 errorUsage();
             }
         } else if (strcmp(argv[i], "-I") == 0) {
-            if (i + 1 < argc) {
+            // an empty replace string would match everywhere, without end
+            if (i + 1 < argc && argv[i + 1][0] != '\0') {
                 replaceIcommand = argv[++i];
             } else {
                 errorUsage();
             }
+        } else if (strcmp(argv[i], "-P") == 0) {
+            if (i + 1 < argc && (maxProcs = atoi(argv[++i])) >= 0) {
+                continue;
+            }
+            errorUsage();
         } else if (strcmp(argv[i], "-r") == 0) {
             rCommand = true;
         } else if (strcmp(argv[i], "-t") == 0) {
             tCommand = true;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            if (i + 1 >= argc) {
+                errorUsage();
+            }
+            cacheDir = argv[++i];
+            if (mkdir(cacheDir, 0755) != 0 && errno != EEXIST) {
+                perror(cacheDir);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--joblog") == 0) {
+            if (i + 1 >= argc) {
+                errorUsage();
+            }
+            if ((jobLog = fopen(argv[++i], "w")) == NULL) {
+                perror(argv[i]);
+                return EXIT_FAILURE;
+            }
         } else {
-            commandArgs.args[commandArgs.count++] = argv[i];
+            addArg(&commandArgs, argv[i]);
         }
     }
 
-    ArgsList inputs;
-    inputs.count = 0;
-    readInput(&inputs);
-
-    if (inputs.count == 0 && rCommand) {
-        return 0;
-    }
-
     if (num != -1 && replaceIcommand != NULL) {
         printf("-n and -I are mutually exclusive\n");
         return 1;
     }
-
+    // -I substitutes one input at a time
     if (replaceIcommand != NULL) {
-        withICommand(&inputs);
+        num = 1;
+    }
+
+    maxBytes = argumentSpace();
+    if (maxChars == -1 || maxChars > maxBytes) {
+        maxChars = maxBytes;
+    }
+
+    for (int k = 0; k < commandArgs.count; k++) {
+        baseChars += strlen(commandArgs.args[k]) + 1;
+        baseBytes += strlen(commandArgs.args[k]) + 1 + sizeof(char *);
+    }
+
+    if (umeminit(ARENA_REGION, FIRST_FIT) != 0 || uarenainit(&batchArena, ARENA_CHUNK) != 0) {
+        fprintf(stderr, "myxargs: cannot set up the batch arena\n");
+        return EXIT_FAILURE;
+    }
+
+    if (jobLog != NULL || cacheDir != NULL) {
+        jobSlots = maxProcs > 0 ? maxProcs : INITIAL_JOBS;
+        jobs = calloc(jobSlots, sizeof(Job));
+        if (jobs == NULL) {
+            perror("calloc");
+            return EXIT_FAILURE;
+        }
+    }
+    if (jobLog != NULL) {
+        fprintf(jobLog, "Seq\tStart\tEnd\tWall\tUser\tSys\tMaxRSS\tExit\tSignal\tCommand\n");
+    }
+    runStart = monotonicTime();
+
+    // with no input nothing runs, so -r needs no check of its own
+    if (delimiter == -1) {
+        readInput();
     } else {
-        withoutICommand(&inputs);
+        readDelimitedInput();
+    }
+    waitForAll();
+
+    if (jobLog != NULL) {
+        fclose(jobLog);
+        printJobSummary();
+    }
+    if (cacheDir != NULL && jobLog != NULL) {
+        fprintf(stderr, "myxargs: cache %d hits, %d misses\n", cacheHits, cacheMisses);
     }
+    free(jobs);
+    uarenadestroy(&batchArena);
 
-    return 0;
+    return exitStatus;
 }
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Regression checks for myxargs: arguments must come out exactly as they went
+# in, across as many batches as the input takes.
+#
+# usage: ./myxargs_test.sh [path to myxargs]
+BIN=${1:-./myxargs}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+status=0
+
+check() {
+    if cmp -s "$DIR/expected" "$DIR/got"; then
+        echo "ok    $1"
+    else
+        echo "FAIL  $1"
+        status=1
+    fi
+}
+
+# a million numbers take several ARG_MAX batches
+seq 1 1000000 > "$DIR/expected"
+seq 1 1000000 | "$BIN" echo | tr ' ' '\n' > "$DIR/got"
+batches=$(seq 1 1000000 | "$BIN" echo | wc -l)
+check "seq 1000000 through $batches batches"
+
+seq 1 1000000 | tr '\n' '\0' | "$BIN" -0 echo | tr ' ' '\n' > "$DIR/got"
+check "seq 1000000 through -0"
+
+printf 'aaaa\nbbbb\ncccc\ndddd\neeee\n' > "$DIR/expected"
+printf 'aaaa bbbb cccc dddd eeee\n' | "$BIN" -s 20 echo | tr ' ' '\n' > "$DIR/got"
+check "-s 20 splits without losing a word"
+
+# no shell runs the command, so nothing is stripped from the input
+printf '%s\n' 'a(1).txt' 'x&y' '$HOME;ls|*?' > "$DIR/expected"
+printf 'a(1).txt x&y $HOME;ls|*?\n' | "$BIN" -n 1 echo > "$DIR/got"
+check "shell characters pass through"
+
+# --cache: a different program under the same name on PATH must miss
+mkdir "$DIR/bin1" "$DIR/bin2"
+printf '#!/bin/sh\necho one "$@"\n' > "$DIR/bin1/tool"
+printf '#!/bin/sh\necho two "$@"\n' > "$DIR/bin2/tool"
+chmod +x "$DIR/bin1/tool" "$DIR/bin2/tool"
+echo x | PATH="$DIR/bin1:$PATH" "$BIN" --cache "$DIR/cache" tool > /dev/null
+echo "two x" > "$DIR/expected"
+echo x | PATH="$DIR/bin2:$DIR/bin1:$PATH" "$BIN" --cache "$DIR/cache" tool > "$DIR/got"
+check "--cache misses when PATH finds another program"
+
+# a command that can't be started stops everything, with one error
+printf 'a\nb\nc\n' | "$BIN" -n 1 myxargs-no-such-command 2> "$DIR/errors"
+code=$?
+if [ $code -eq 127 ] && [ "$(wc -l < "$DIR/errors")" -eq 1 ]; then
+    echo "ok    missing command exits 127 after one error"
+else
+    echo "FAIL  missing command exited $code after $(wc -l < "$DIR/errors") errors"
+    status=1
+fi
+
+exit $status
@@ -1,6 +1,60 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
 #include <pthread.h>
-static volatile int counter = 0;
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define MAX_THREADS 16
+#define CACHE_LINE 64
+#define SLOPPY_THRESHOLD 1024   // local increments a sloppy counter batches before taking the lock
+#define CPU_SLOTS 64            // per-CPU counter slots, CPU number modulo this
+#define CPU_RECHECK 256         // increments between sched_getcpu() calls
+
+static volatile long counter = 0;
+
+// The counters being compared. Each one sits on its own cache line so they
+// don't interfere with each other, only with themselves
+static atomic_long atomic_counter __attribute__((aligned(CACHE_LINE)));
+static long mutex_counter __attribute__((aligned(CACHE_LINE)));
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    atomic_uint next;           // ticket handed to the next thread that arrives
+    atomic_uint serving;        // ticket allowed in
+    long value;
+} __attribute__((aligned(CACHE_LINE))) ticket_counter;
+
+static struct {
+    atomic_int locked;
+    long value;
+} __attribute__((aligned(CACHE_LINE))) ttas_counter;
+
+static struct {
+    long global;                // protected by lock, behind by up to threads * SLOPPY_THRESHOLD
+    pthread_mutex_t lock;
+} __attribute__((aligned(CACHE_LINE))) sloppy_counter = { 0, PTHREAD_MUTEX_INITIALIZER };
+
+static struct {
+    atomic_long value;
+} __attribute__((aligned(CACHE_LINE))) cpu_counter[CPU_SLOTS];
+
+static long iterations = 10000000;
+static int spin_limit = 1000;   // polls before yielding, 0 on a single CPU where the holder can't run while we spin
+static pthread_barrier_t start_line;
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
 // mythread()
 //
 // Simply adds 1 to counter repeatedly, in a loop
@@ -9,32 +63,282 @@ static volatile int counter = 0;
 //
 void *mythread(void *arg)
 {
-    printf("%s: begin\n", (char *)arg);
-    int i;
-    for (i = 0; i < 1e7; i++)
+    long i;
+    pthread_barrier_wait(&start_line);
+    for (i = 0; i < iterations; i++)
     {
         counter = counter + 1;
     }
-    printf("%s: done\n", (char *)arg);
     return NULL;
 }
 
+// atomicthread()
+//
+// One locked read-modify-write per increment. Always exact, but every
+// thread bounces the same cache line
+//
+void *atomicthread(void *arg)
+{
+    pthread_barrier_wait(&start_line);
+    for (long i = 0; i < iterations; i++)
+    {
+        atomic_fetch_add_explicit(&atomic_counter, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+// mutexthread()
+//
+void *mutexthread(void *arg)
+{
+    pthread_barrier_wait(&start_line);
+    for (long i = 0; i < iterations; i++)
+    {
+        pthread_mutex_lock(&mutex);
+        mutex_counter++;
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+// ticketthread()
+//
+// FIFO spinlock: take a ticket, spin until it is served. Fair, but a
+// preempted holder (or next in line) stalls everyone behind it
+//
+void *ticketthread(void *arg)
+{
+    pthread_barrier_wait(&start_line);
+    for (long i = 0; i < iterations; i++)
+    {
+        unsigned int ticket = atomic_fetch_add_explicit(&ticket_counter.next, 1, memory_order_relaxed);
+        int spins = 0;
+        while (atomic_load_explicit(&ticket_counter.serving, memory_order_acquire) != ticket)
+        {
+            if (++spins < spin_limit)
+                cpu_relax();
+            else
+                sched_yield();  // the ticket we wait on may belong to a thread that isn't running
+        }
+        ticket_counter.value++;
+        atomic_store_explicit(&ticket_counter.serving, ticket + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+// ttasthread()
+//
+// Test-and-test-and-set: spin on a plain load, which stays in the local
+// cache, and only try the exchange once the lock looks free
+//
+void *ttasthread(void *arg)
+{
+    pthread_barrier_wait(&start_line);
+    for (long i = 0; i < iterations; i++)
+    {
+        int spins = 0;
+        while (atomic_exchange_explicit(&ttas_counter.locked, 1, memory_order_acquire))
+        {
+            while (atomic_load_explicit(&ttas_counter.locked, memory_order_relaxed))
+            {
+                if (++spins < spin_limit)
+                    cpu_relax();
+                else
+                    sched_yield();
+            }
+        }
+        ttas_counter.value++;
+        atomic_store_explicit(&ttas_counter.locked, 0, memory_order_release);
+    }
+    return NULL;
+}
+
+// sloppythread()
+//
+// Count locally and add the batch to the global counter every
+// SLOPPY_THRESHOLD increments. The global value lags while threads run
+// but is exact once each has flushed its remainder
+//
+void *sloppythread(void *arg)
+{
+    long local = 0;
+    pthread_barrier_wait(&start_line);
+    for (long i = 0; i < iterations; i++)
+    {
+        if (++local == SLOPPY_THRESHOLD)
+        {
+            pthread_mutex_lock(&sloppy_counter.lock);
+            sloppy_counter.global += local;
+            pthread_mutex_unlock(&sloppy_counter.lock);
+            local = 0;
+        }
+    }
+    pthread_mutex_lock(&sloppy_counter.lock);
+    sloppy_counter.global += local;
+    pthread_mutex_unlock(&sloppy_counter.lock);
+    return NULL;
+}
+
+// cputhread()
+//
+// Add to the padded slot of the CPU we are running on. Threads that share
+// a CPU, or migrate, can land on the same slot, so the add is still atomic,
+// but it is almost never contended. Reading sums every slot
+//
+void *cputhread(void *arg)
+{
+    int slot = 0;
+    pthread_barrier_wait(&start_line);
+    for (long i = 0; i < iterations; i++)
+    {
+        if (i % CPU_RECHECK == 0)
+        {
+            slot = sched_getcpu() % CPU_SLOTS;
+        }
+        atomic_fetch_add_explicit(&cpu_counter[slot].value, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void reset(void)
+{
+    counter = 0;
+    atomic_store(&atomic_counter, 0);
+    mutex_counter = 0;
+    atomic_store(&ticket_counter.next, 0);
+    atomic_store(&ticket_counter.serving, 0);
+    ticket_counter.value = 0;
+    atomic_store(&ttas_counter.locked, 0);
+    ttas_counter.value = 0;
+    sloppy_counter.global = 0;
+    for (int i = 0; i < CPU_SLOTS; i++)
+    {
+        atomic_store(&cpu_counter[i].value, 0);
+    }
+}
+
+static long read_racy(void) { return counter; }
+static long read_atomic(void) { return atomic_load(&atomic_counter); }
+static long read_mutex(void) { return mutex_counter; }
+static long read_ticket(void) { return ticket_counter.value; }
+static long read_ttas(void) { return ttas_counter.value; }
+static long read_sloppy(void) { return sloppy_counter.global; }
+
+static long read_cpu(void)
+{
+    long sum = 0;
+    for (int i = 0; i < CPU_SLOTS; i++)
+    {
+        sum += atomic_load(&cpu_counter[i].value);
+    }
+    return sum;
+}
+
+static const struct {
+    const char *name;
+    void *(*thread)(void *);
+    long (*read)(void);
+} strategies[] = {
+    { "racy", mythread, read_racy },
+    { "atomic", atomicthread, read_atomic },
+    { "mutex", mutexthread, read_mutex },
+    { "ticket", ticketthread, read_ticket },
+    { "ttas", ttasthread, read_ttas },
+    { "sloppy", sloppythread, read_sloppy },
+    { "percpu", cputhread, read_cpu },
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 // main()
 //
-// Just launches two threads (pthread_create)
-// and then waits for them (pthread_join)
+// Runs every counter strategy at 1, 2, 4, 8 and 16 threads (or up to -t).
+// Each thread increments the counter once per iteration, so the reported
+// accuracy is how close the final value came to threads * iterations
+//
+// usage: test [-n iterations] [-t maxThreads] [-s strategy]
 //
 int main(int argc, char *argv[])
 {
-    pthread_t p1, p2;
-    printf("main: begin (counter = %d)\n", counter);
-    pthread_create(&p1, NULL, mythread, "A");
-    pthread_create(&p2, NULL, mythread, "B");
+    pthread_t p[MAX_THREADS];
+    int max_threads = MAX_THREADS;
+    const char *only = NULL;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            iterations = atol(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            max_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            only = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [-n iterations] [-t maxThreads] [-s strategy]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations <= 0 || max_threads <= 0 || max_threads > MAX_THREADS)
+    {
+        fprintf(stderr, "iterations must be positive and maxThreads between 1 and %d\n", MAX_THREADS);
+        return 1;
+    }
+    if (only != NULL)
+    {
+        size_t s = 0;
+        while (s < sizeof(strategies) / sizeof(strategies[0]) && strcmp(only, strategies[s].name) != 0)
+            s++;
+        if (s == sizeof(strategies) / sizeof(strategies[0]))
+        {
+            fprintf(stderr, "unknown strategy '%s', expected racy, atomic, mutex, ticket, ttas, sloppy or percpu\n", only);
+            fprintf(stderr, "usage: %s [-n iterations] [-t maxThreads] [-s strategy]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (sysconf(_SC_NPROCESSORS_ONLN) == 1)
+        spin_limit = 0;
 
-    // join waits for the threads to finish
-    pthread_join(p1, NULL);
-    pthread_join(p2, NULL);
-    printf("main: done with both (counter = %d)\n",
-           counter);
+    printf("%-8s %7s %12s %14s %14s %9s\n", "strategy", "threads", "Mops/s", "final", "expected", "accuracy");
+    for (size_t s = 0; s < sizeof(strategies) / sizeof(strategies[0]); s++)
+    {
+        if (only != NULL && strcmp(only, strategies[s].name) != 0)
+            continue;
+
+        for (int threads = 1, next; threads <= max_threads; threads = next)
+        {
+            // Powers of two, with max_threads itself as the last row
+            next = (threads < max_threads && threads * 2 > max_threads) ? max_threads : threads * 2;
+
+            reset();
+            pthread_barrier_init(&start_line, NULL, threads + 1);
+            for (i = 0; i < threads; i++)
+            {
+                pthread_create(&p[i], NULL, strategies[s].thread, NULL);
+            }
+
+            // Every thread is created and waiting; the clock starts as they are released.
+            // Read it before the barrier, since on few CPUs the threads may finish before main runs again
+            double start = now();
+            pthread_barrier_wait(&start_line);
+            for (i = 0; i < threads; i++)
+            {
+                pthread_join(p[i], NULL);
+            }
+            double elapsed = now() - start;
+            pthread_barrier_destroy(&start_line);
+
+            long expected = threads * iterations;
+            long final = strategies[s].read();
+            printf("%-8s %7d %12.1f %14ld %14ld %8.2f%%\n", strategies[s].name, threads,
+                   expected / elapsed / 1e6, final, expected, 100.0 * final / expected);
+        }
+    }
     return 0;
 }
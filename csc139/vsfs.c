@@ -0,0 +1,847 @@
+// Native vsfs: the file system vsfs.py simulates, kept in a real image file.
+//
+// build: gcc -O2 -o vsfs vsfs.c
+//
+// Takes vsfs.py's options and runs the same random create/mkdir/link/unlink/
+// write workload, printing the same output for the same seed. The file system
+// itself lives in an image (-f, vsfs.img) mapped with mmap:
+//   superblock | inode bitmap | data bitmap | inode table | data blocks
+// The bitmaps are 64-bit words. Allocation starts at a hint word, below which
+// every word is known to be full, and takes the first zero bit with ctzll, so
+// it is still the lowest free number, as in vsfs.py, without a bit-by-bit scan.
+// Metadata is changed in place in the mapping and the pages touched are
+// remembered, then written back together with msync when the image is
+// unmounted, or every -b operations, rather than once per change.
+//
+// -q drops the per-operation output and reports operations per second instead,
+// for benchmarking with millions of operations.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define VSFS_MAGIC 0x73667376 // "vsfs"
+#define BLOCK_SIZE 1024
+#define PAGE_SIZE 4096
+#define DIR_ENTRIES 32 // entries in a directory block, counting . and ..
+#define NAME_LENGTH 28 // bytes for a name in a directory entry, with its '\0'
+
+enum { TYPE_FREE = 0, TYPE_DIR = 'd', TYPE_FILE = 'f' };
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// on-disk structures
+//
+typedef struct {
+    uint32_t magic;
+    uint32_t blockSize;
+    int32_t numInodes;
+    int32_t numData;
+    uint64_t inodeBitmap; // byte offsets of each region
+    uint64_t dataBitmap;
+    uint64_t inodeTable;
+    uint64_t dataBlocks;
+    uint64_t imageSize;
+    int32_t inodesUsed;
+    int32_t dataUsed;
+    int32_t inodeHint; // bitmap words below these are full
+    int32_t dataHint;
+} Superblock;
+
+typedef struct {
+    uint8_t type;
+    uint8_t unused;
+    uint16_t entries; // directories: entries in use in the block
+    int32_t refCnt;
+    int32_t addr; // the one data block, -1 for none
+    int32_t reserved;
+} Inode;
+
+typedef struct {
+    int32_t inum;
+    char name[NAME_LENGTH];
+} Dirent;
+
+// a bitmap in the image, and the superblock fields that go with it
+typedef struct {
+    uint64_t *words;
+    int size;
+    int32_t *used;
+    int32_t *hint;
+} Bitmap;
+
+// the mounted image
+typedef struct {
+    char *base;
+    size_t size;
+    Superblock *sb;
+    Bitmap ibitmap, dbitmap;
+    Inode *inodes;
+    char *data;
+    // pages changed since the last flush
+    unsigned char *pageDirty;
+    long *dirtyPages;
+    long dirtyCount;
+    long flushes, pagesFlushed;
+} Vsfs;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Python's random(), so -s gives the same workload as vsfs.py
+//
+#define MT_N 624
+#define MT_M 397
+uint32_t mt[MT_N];
+int mti = MT_N + 1;
+
+void initGenrand(uint32_t s) {
+    mt[0] = s;
+    for (mti = 1; mti < MT_N; mti++) {
+        mt[mti] = 1812433253U * (mt[mti - 1] ^ (mt[mti - 1] >> 30)) + mti;
+    }
+}
+
+void initByArray(uint32_t key[], int keyLength) {
+    int i = 1, j = 0;
+    initGenrand(19650218U);
+    for (int k = MT_N > keyLength ? MT_N : keyLength; k; k--) {
+        mt[i] = (mt[i] ^ ((mt[i - 1] ^ (mt[i - 1] >> 30)) * 1664525U)) + key[j] + j;
+        i++;
+        j++;
+        if (i >= MT_N) {
+            mt[0] = mt[MT_N - 1];
+            i = 1;
+        }
+        if (j >= keyLength) {
+            j = 0;
+        }
+    }
+    for (int k = MT_N - 1; k; k--) {
+        mt[i] = (mt[i] ^ ((mt[i - 1] ^ (mt[i - 1] >> 30)) * 1566083941U)) - i;
+        i++;
+        if (i >= MT_N) {
+            mt[0] = mt[MT_N - 1];
+            i = 1;
+        }
+    }
+    mt[0] = 0x80000000U;
+}
+
+uint32_t genrandInt32() {
+    static const uint32_t mag01[2] = { 0, 0x9908b0dfU };
+    uint32_t y;
+
+    if (mti >= MT_N) {
+        int kk;
+        for (kk = 0; kk < MT_N - MT_M; kk++) {
+            y = (mt[kk] & 0x80000000U) | (mt[kk + 1] & 0x7fffffffU);
+            mt[kk] = mt[kk + MT_M] ^ (y >> 1) ^ mag01[y & 1];
+        }
+        for (; kk < MT_N - 1; kk++) {
+            y = (mt[kk] & 0x80000000U) | (mt[kk + 1] & 0x7fffffffU);
+            mt[kk] = mt[kk + (MT_M - MT_N)] ^ (y >> 1) ^ mag01[y & 1];
+        }
+        y = (mt[MT_N - 1] & 0x80000000U) | (mt[0] & 0x7fffffffU);
+        mt[MT_N - 1] = mt[MT_M - 1] ^ (y >> 1) ^ mag01[y & 1];
+        mti = 0;
+    }
+
+    y = mt[mti++];
+    y ^= y >> 11;
+    y ^= (y << 7) & 0x9d2c5680U;
+    y ^= (y << 15) & 0xefc60000U;
+    y ^= y >> 18;
+    return y;
+}
+
+// random.seed(n) for an integer n keys the generator with the 32-bit words of |n|
+void randomSeed(long long n) {
+    unsigned long long value = n < 0 ? -(unsigned long long) n : (unsigned long long) n;
+    uint32_t key[2] = { (uint32_t) value, (uint32_t) (value >> 32) };
+    initByArray(key, key[1] != 0 ? 2 : 1);
+}
+
+double randomDouble() {
+    uint32_t a = genrandInt32() >> 5, b = genrandInt32() >> 6;
+    return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+}
+
+// int(random.random() * n)
+int randomIndex(long n) {
+    return (int) (randomDouble() * n);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// image and batched write-back
+//
+void *checkedMalloc(size_t size) {
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    return ptr;
+}
+
+void markDirty(Vsfs *fs, const void *ptr, size_t length) {
+    long first = ((const char *) ptr - fs->base) / PAGE_SIZE;
+    long last = ((const char *) ptr - fs->base + length - 1) / PAGE_SIZE;
+    for (long page = first; page <= last; page++) {
+        if (!fs->pageDirty[page]) {
+            fs->pageDirty[page] = 1;
+            fs->dirtyPages[fs->dirtyCount++] = page;
+        }
+    }
+}
+
+int comparePages(const void *a, const void *b) {
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+// write back every page changed since the last flush, runs of adjacent pages
+// in one msync each
+void vsfsFlush(Vsfs *fs) {
+    if (fs->dirtyCount == 0) {
+        return;
+    }
+    qsort(fs->dirtyPages, fs->dirtyCount, sizeof(long), comparePages);
+    for (long i = 0; i < fs->dirtyCount;) {
+        long start = i;
+        while (i + 1 < fs->dirtyCount && fs->dirtyPages[i + 1] == fs->dirtyPages[i] + 1) {
+            i++;
+        }
+        i++;
+        if (msync(fs->base + fs->dirtyPages[start] * PAGE_SIZE, (i - start) * PAGE_SIZE, MS_SYNC) != 0) {
+            perror("msync");
+            exit(1);
+        }
+    }
+    for (long i = 0; i < fs->dirtyCount; i++) {
+        fs->pageDirty[fs->dirtyPages[i]] = 0;
+    }
+    fs->flushes++;
+    fs->pagesFlushed += fs->dirtyCount;
+    fs->dirtyCount = 0;
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// bits past the end of a bitmap are set, so they are never handed out
+void bitmapInit(Bitmap *bitmap, uint64_t *words, int size, int32_t *used, int32_t *hint) {
+    bitmap->words = words;
+    bitmap->size = size;
+    bitmap->used = used;
+    bitmap->hint = hint;
+    if (size % 64 != 0) {
+        words[size / 64] = ~0ULL << (size % 64);
+    }
+}
+
+// lowest free number, or -1
+int bitmapAlloc(Vsfs *fs, Bitmap *bitmap) {
+    int wordCount = (bitmap->size + 63) / 64;
+    for (int w = *bitmap->hint; w < wordCount; w++) {
+        uint64_t word = bitmap->words[w];
+        if (word != ~0ULL) {
+            int bit = __builtin_ctzll(~word);
+            bitmap->words[w] = word | (1ULL << bit);
+            *bitmap->hint = w;
+            (*bitmap->used)++;
+            markDirty(fs, &bitmap->words[w], sizeof(uint64_t));
+            return w * 64 + bit;
+        }
+    }
+    *bitmap->hint = wordCount;
+    return -1;
+}
+
+void bitmapFree(Vsfs *fs, Bitmap *bitmap, int num) {
+    uint64_t *word = &bitmap->words[num / 64];
+    if (!(*word & (1ULL << (num % 64)))) {
+        fprintf(stderr, "vsfs: freeing %d, which is not allocated\n", num);
+        exit(1);
+    }
+    *word &= ~(1ULL << (num % 64));
+    (*bitmap->used)--;
+    if (num / 64 < *bitmap->hint) {
+        *bitmap->hint = num / 64;
+    }
+    markDirty(fs, word, sizeof(uint64_t));
+}
+
+bool bitmapIsSet(Bitmap *bitmap, int num) {
+    return bitmap->words[num / 64] & (1ULL << (num % 64));
+}
+
+int bitmapNumFree(Bitmap *bitmap) {
+    return bitmap->size - *bitmap->used;
+}
+
+Dirent *dirBlock(Vsfs *fs, int inum) {
+    return (Dirent *) (fs->data + (size_t) fs->inodes[inum].addr * BLOCK_SIZE);
+}
+
+void setInode(Vsfs *fs, int inum, int type, int addr, int refCnt) {
+    Inode *inode = &fs->inodes[inum];
+    inode->type = type;
+    inode->addr = addr;
+    inode->refCnt = refCnt;
+    inode->entries = 0;
+    markDirty(fs, inode, sizeof(Inode));
+}
+
+void addDirEntry(Vsfs *fs, int dirInum, const char *name, int inum) {
+    Inode *dir = &fs->inodes[dirInum];
+    Dirent *entry = &dirBlock(fs, dirInum)[dir->entries++];
+    entry->inum = inum;
+    strncpy(entry->name, name, NAME_LENGTH - 1);
+    entry->name[NAME_LENGTH - 1] = '\0';
+    markDirty(fs, entry, sizeof(Dirent));
+    markDirty(fs, dir, sizeof(Inode));
+}
+
+// index of name in the directory, or -1
+int findDirEntry(Vsfs *fs, int dirInum, const char *name) {
+    Dirent *entries = dirBlock(fs, dirInum);
+    for (int i = 0; i < fs->inodes[dirInum].entries; i++) {
+        if (strcmp(entries[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// create and map an image, with an empty root directory as inode 0
+void vsfsFormat(Vsfs *fs, const char *path, int numInodes, int numData) {
+    Superblock sb = { .magic = VSFS_MAGIC, .blockSize = BLOCK_SIZE, .numInodes = numInodes, .numData = numData };
+    sb.inodeBitmap = BLOCK_SIZE;
+    sb.dataBitmap = alignUp(sb.inodeBitmap + (numInodes + 63) / 64 * 8, BLOCK_SIZE);
+    sb.inodeTable = alignUp(sb.dataBitmap + (numData + 63) / 64 * 8, BLOCK_SIZE);
+    sb.dataBlocks = alignUp(sb.inodeTable + (uint64_t) numInodes * sizeof(Inode), BLOCK_SIZE);
+    sb.imageSize = alignUp(sb.dataBlocks + (uint64_t) numData * BLOCK_SIZE, PAGE_SIZE);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sb.imageSize) != 0) {
+        perror(path);
+        exit(1);
+    }
+    fs->size = sb.imageSize;
+    fs->base = mmap(NULL, fs->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fs->base == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);
+
+    long pages = fs->size / PAGE_SIZE;
+    fs->pageDirty = calloc(pages, 1);
+    fs->dirtyPages = checkedMalloc(pages * sizeof(long));
+    fs->dirtyCount = fs->flushes = fs->pagesFlushed = 0;
+
+    fs->sb = (Superblock *) fs->base;
+    *fs->sb = sb;
+    bitmapInit(&fs->ibitmap, (uint64_t *) (fs->base + sb.inodeBitmap), numInodes, &fs->sb->inodesUsed, &fs->sb->inodeHint);
+    bitmapInit(&fs->dbitmap, (uint64_t *) (fs->base + sb.dataBitmap), numData, &fs->sb->dataUsed, &fs->sb->dataHint);
+    fs->inodes = (Inode *) (fs->base + sb.inodeTable);
+    fs->data = fs->base + sb.dataBlocks;
+    for (int i = 0; i < numInodes; i++) {
+        fs->inodes[i].addr = -1;
+    }
+    markDirty(fs, fs->base, sb.dataBlocks);
+
+    // root directory
+    int root = bitmapAlloc(fs, &fs->ibitmap);
+    int block = bitmapAlloc(fs, &fs->dbitmap);
+    setInode(fs, root, TYPE_DIR, block, 2);
+    addDirEntry(fs, root, ".", root);
+    addDirEntry(fs, root, "..", root);
+    vsfsFlush(fs);
+}
+
+void vsfsUnmount(Vsfs *fs) {
+    vsfsFlush(fs);
+    munmap(fs->base, fs->size);
+    free(fs->pageDirty);
+    free(fs->dirtyPages);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// operations, with vsfs.py's rules
+//
+// creat() or mkdir() name in directory parent; returns the new inode or -1
+int vsfsCreate(Vsfs *fs, int parent, const char *name, int type) {
+    if (fs->inodes[parent].entries >= DIR_ENTRIES || findDirEntry(fs, parent, name) != -1) {
+        return -1;
+    }
+
+    int inum = bitmapAlloc(fs, &fs->ibitmap);
+    if (inum == -1) {
+        return -1;
+    }
+
+    // a directory gets its block for . and .. right away
+    int block = -1;
+    if (type == TYPE_DIR) {
+        block = bitmapAlloc(fs, &fs->dbitmap);
+        if (block == -1) {
+            bitmapFree(fs, &fs->ibitmap, inum);
+            return -1;
+        }
+    }
+    setInode(fs, inum, type, block, type == TYPE_DIR ? 2 : 1);
+    if (type == TYPE_DIR) {
+        addDirEntry(fs, inum, ".", inum);
+        addDirEntry(fs, inum, "..", parent);
+        fs->inodes[parent].refCnt++;
+    }
+
+    addDirEntry(fs, parent, name, inum);
+    return inum;
+}
+
+// link() target as name in directory parent; returns target or -1
+int vsfsLink(Vsfs *fs, int target, int parent, const char *name) {
+    if (fs->inodes[parent].entries >= DIR_ENTRIES || findDirEntry(fs, parent, name) != -1) {
+        return -1;
+    }
+    fs->inodes[target].refCnt++;
+    markDirty(fs, &fs->inodes[target], sizeof(Inode));
+    addDirEntry(fs, parent, name, target);
+    return target;
+}
+
+// unlink() name from directory parent, freeing the inode and its block with
+// the last link; returns -1 if there is no such name
+int vsfsUnlink(Vsfs *fs, int parent, const char *name) {
+    int index = findDirEntry(fs, parent, name);
+    if (index == -1) {
+        return -1;
+    }
+    Dirent *entries = dirBlock(fs, parent);
+    int inum = entries[index].inum;
+    Inode *inode = &fs->inodes[inum];
+
+    if (inode->type == TYPE_DIR) {
+        fs->inodes[parent].refCnt--;
+    }
+    if (inode->refCnt == 1) {
+        if (inode->addr != -1) {
+            bitmapFree(fs, &fs->dbitmap, inode->addr);
+        }
+        bitmapFree(fs, &fs->ibitmap, inum);
+        inode->type = TYPE_FREE;
+        inode->addr = -1;
+    } else {
+        inode->refCnt--;
+    }
+    markDirty(fs, inode, sizeof(Inode));
+
+    // the entries after it move up, keeping the directory in order
+    Inode *dir = &fs->inodes[parent];
+    memmove(&entries[index], &entries[index + 1], (dir->entries - index - 1) * sizeof(Dirent));
+    dir->entries--;
+    markDirty(fs, &entries[index], (dir->entries - index + 1) * sizeof(Dirent));
+    markDirty(fs, dir, sizeof(Inode));
+    return 0;
+}
+
+// write one block to a file that has none yet; returns -1 if it is full or
+// the disk is
+int vsfsWrite(Vsfs *fs, int inum, char data) {
+    if (fs->inodes[inum].addr != -1) {
+        return -1;
+    }
+    int block = bitmapAlloc(fs, &fs->dbitmap);
+    if (block == -1) {
+        return -1;
+    }
+    char *contents = fs->data + (size_t) block * BLOCK_SIZE;
+    contents[0] = data;
+    contents[1] = '\0';
+    markDirty(fs, contents, 2);
+    fs->inodes[inum].addr = block;
+    markDirty(fs, &fs->inodes[inum], sizeof(Inode));
+    return 0;
+}
+
+void dumpBitmap(Bitmap *bitmap) {
+    for (int i = 0; i < bitmap->size; i++) {
+        putchar(bitmapIsSet(bitmap, i) ? '1' : '0');
+    }
+    putchar('\n');
+}
+
+// print the state the way vsfs.py's fs.dump() does
+void vsfsDump(Vsfs *fs) {
+    int numInodes = fs->sb->numInodes, numData = fs->sb->numData;
+    int *owner = checkedMalloc(numData * sizeof(int));
+    for (int b = 0; b < numData; b++) {
+        owner[b] = -1;
+    }
+
+    printf("inode bitmap  ");
+    dumpBitmap(&fs->ibitmap);
+    printf("inodes       ");
+    for (int i = 0; i < numInodes; i++) {
+        Inode *inode = &fs->inodes[i];
+        if (inode->type == TYPE_FREE) {
+            printf("[]");
+        } else {
+            printf("[%c a:%d r:%d]", inode->type, inode->addr, inode->refCnt);
+            if (inode->addr != -1) {
+                owner[inode->addr] = i;
+            }
+        }
+    }
+    printf("\n");
+    printf("data bitmap   ");
+    dumpBitmap(&fs->dbitmap);
+    printf("data         ");
+    for (int b = 0; b < numData; b++) {
+        if (owner[b] == -1) {
+            printf("[]");
+        } else if (fs->inodes[owner[b]].type == TYPE_DIR) {
+            Dirent *entries = dirBlock(fs, owner[b]);
+            printf("[");
+            for (int i = 0; i < fs->inodes[owner[b]].entries; i++) {
+                printf(i ? " (%s,%d)" : "(%s,%d)", entries[i].name, entries[i].inum);
+            }
+            printf("]");
+        } else {
+            printf("[%s]", fs->data + (size_t) b * BLOCK_SIZE);
+        }
+    }
+    printf("\n");
+    free(owner);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// the random workload of vsfs.py
+//
+// a file or directory the workload knows about. The inode of a path can't
+// change while it is in the list, so it is kept here instead of looked up
+typedef struct {
+    char *path;
+    int inum;
+    int parent; // the directory it is in
+} Entry;
+
+// vsfs.py's list of files, in order, with random picks and removals in
+// O(log n): entries are only appended, a removed one is just marked, and a
+// Fenwick tree over the live marks finds the k-th live entry
+typedef struct {
+    Entry *slots;
+    char *live;
+    int *tree;
+    int capacity, used, count, top; // top: highest power of two <= capacity
+} FileList;
+
+void fileListInit(FileList *list, int capacity) {
+    list->slots = checkedMalloc(capacity * sizeof(Entry));
+    list->live = calloc(capacity + 1, 1);
+    list->tree = calloc(capacity + 1, sizeof(int));
+    list->capacity = capacity;
+    list->used = list->count = 0;
+    for (list->top = 1; list->top * 2 <= capacity; list->top *= 2) {
+    }
+}
+
+void fenwickAdd(FileList *list, int slot, int delta) {
+    for (int i = slot + 1; i <= list->capacity; i += i & -i) {
+        list->tree[i] += delta;
+    }
+}
+
+void fileListAppend(FileList *list, Entry entry) {
+    list->slots[list->used] = entry;
+    list->live[list->used] = 1;
+    fenwickAdd(list, list->used++, 1);
+    list->count++;
+}
+
+// slot of the k-th live entry, from 0
+int fileListSlot(FileList *list, int k) {
+    int position = 0;
+    for (int step = list->top; step > 0; step /= 2) {
+        if (position + step <= list->capacity && list->tree[position + step] <= k) {
+            position += step;
+            k -= list->tree[position];
+        }
+    }
+    return position;
+}
+
+void fileListRemove(FileList *list, int slot) {
+    list->live[slot] = 0;
+    fenwickAdd(list, slot, -1);
+    list->count--;
+}
+
+Vsfs gFs;
+FileList files;
+Entry *dirs;
+int dirCount;
+char *pathPool; // path strings, never freed before exit
+size_t pathUsed, pathCapacity;
+bool printOps = true, printState = true, printFinal = true, quiet = false;
+
+char *makePath(const char *parent, const char *name) {
+    size_t parentLength = strcmp(parent, "/") == 0 ? 0 : strlen(parent);
+    size_t length = parentLength + 1 + strlen(name) + 1;
+    if (pathUsed + length > pathCapacity) {
+        pathCapacity = 1 << 20;
+        pathPool = checkedMalloc(pathCapacity);
+        pathUsed = 0;
+    }
+    char *path = pathPool + pathUsed;
+    memcpy(path, parent, parentLength);
+    path[parentLength] = '/';
+    strcpy(path + parentLength + 1, name);
+    pathUsed += length;
+    return path;
+}
+
+const char *makeName() {
+    static const char *names[] = { "a", "b", "c", "d", "e", "f", "g", "h", "j", "k", "m", "n",
+                                   "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z" };
+    return names[randomIndex(24)];
+}
+
+const char *lastComponent(const char *path) {
+    return strrchr(path, '/') + 1;
+}
+
+int doDelete() {
+    if (files.count == 0) {
+        return -1;
+    }
+    int slot = fileListSlot(&files, randomIndex(files.count));
+    Entry *file = &files.slots[slot];
+    if (printOps) {
+        printf("unlink(\"%s\");\n", file->path);
+    }
+    vsfsUnlink(&gFs, file->parent, lastComponent(file->path));
+    fileListRemove(&files, slot);
+    return 0;
+}
+
+int doLink() {
+    if (files.count == 0) {
+        return -1;
+    }
+    Entry *parent = &dirs[randomIndex(dirCount)];
+    const char *name = makeName();
+    Entry *target = &files.slots[fileListSlot(&files, randomIndex(files.count))];
+
+    if (vsfsLink(&gFs, target->inum, parent->inum, name) < 0) {
+        return -1;
+    }
+    Entry link = { makePath(parent->path, name), target->inum, parent->inum };
+    fileListAppend(&files, link);
+    if (printOps) {
+        printf("link(\"%s\", \"%s\");\n", target->path, link.path);
+    }
+    return 0;
+}
+
+int doCreate(int type) {
+    Entry *parent = &dirs[randomIndex(dirCount)];
+    const char *name = makeName();
+
+    int inum = vsfsCreate(&gFs, parent->inum, name, type);
+    if (inum < 0) {
+        return -1;
+    }
+    Entry created = { makePath(parent->path, name), inum, parent->inum };
+    if (type == TYPE_DIR) {
+        dirs[dirCount++] = created;
+    } else {
+        fileListAppend(&files, created);
+    }
+    if (printOps) {
+        printf("%s(\"%s\");\n", type == TYPE_DIR ? "mkdir" : "creat", created.path);
+    }
+    return 0;
+}
+
+int doAppend() {
+    if (files.count == 0) {
+        return -1;
+    }
+    Entry *file = &files.slots[fileListSlot(&files, randomIndex(files.count))];
+    char data = 'a' + randomIndex(26);
+    if (vsfsWrite(&gFs, file->inum, data) < 0) {
+        return -1;
+    }
+    if (printOps) {
+        printf("fd=open(\"%s\", O_WRONLY|O_APPEND); write(fd, buf, BLOCKSIZE); close(fd);\n", file->path);
+    }
+    return 0;
+}
+
+void printPathList(const char *label, Entry *entries, char *live, int count) {
+    printf("%s [", label);
+    bool first = true;
+    for (int i = 0; i < count; i++) {
+        if (live == NULL || live[i]) {
+            printf(first ? "'%s'" : ", '%s'", entries[i].path);
+            first = false;
+        }
+    }
+    printf("]\n");
+}
+
+// returns the number of attempts, successful or not
+long run(long numRequests, long batch) {
+    long attempts = 0;
+
+    if (!quiet) {
+        printf("Initial state\n\n");
+        vsfsDump(&gFs);
+        printf("\n");
+    }
+
+    for (long i = 0; i < numRequests; i++) {
+        if (!printOps && !quiet) {
+            printf("Which operation took place?\n");
+        }
+        int rc = -1;
+        while (rc == -1) {
+            double r = randomDouble();
+            if (r < 0.3) {
+                rc = doAppend();
+            } else if (r < 0.5) {
+                rc = doDelete();
+            } else if (r < 0.7) {
+                rc = doLink();
+            } else if (randomDouble() < 0.75) {
+                rc = doCreate(TYPE_FILE);
+            } else {
+                rc = doCreate(TYPE_DIR);
+            }
+            attempts++;
+            if (bitmapNumFree(&gFs.ibitmap) == 0) {
+                printf("File system out of inodes; rerun with more via command-line flag?\n");
+                vsfsUnmount(&gFs);
+                exit(1);
+            }
+            if (bitmapNumFree(&gFs.dbitmap) == 0) {
+                printf("File system out of data blocks; rerun with more via command-line flag?\n");
+                vsfsUnmount(&gFs);
+                exit(1);
+            }
+        }
+        if (batch > 0 && (i + 1) % batch == 0) {
+            vsfsFlush(&gFs);
+        }
+        if (quiet) {
+            continue;
+        }
+        if (printState) {
+            printf("\n");
+            vsfsDump(&gFs);
+            printf("\n");
+        } else {
+            printf("\n");
+            printf("  State of file system (inode bitmap, inodes, data bitmap, data)?\n");
+            printf("\n");
+        }
+    }
+
+    if (printFinal) {
+        printf("\n");
+        printf("Summary of files, directories::\n");
+        printf("\n");
+        printPathList("  Files:      ", files.slots, files.live, files.used);
+        printPathList("  Directories:", dirs, NULL, dirCount);
+        printf("\n");
+    }
+    return attempts;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "usage: %s [-s seed] [-i numInodes] [-d numData] [-n numRequests] [-r] [-p] [-c]\n"
+                    "       [-f image] [-b opsPerFlush] [-q]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    long long seed = 0;
+    long numInodes = 8, numData = 8, numRequests = 10, batch = 0;
+    bool reverse = false, finalList = false, solve = false;
+    const char *image = "vsfs.img";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            reverse = true;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            finalList = true;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            solve = true;
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else if (i + 1 >= argc) {
+            usage(argv[0]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            seed = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0) {
+            numInodes = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            numData = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            numRequests = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            image = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batch = atol(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (numInodes < 1 || numData < 1 || numInodes > INT32_MAX / 2 || numData > INT32_MAX / 2 || numRequests < 0) {
+        fprintf(stderr, "vsfs: need at least one inode and data block, and a request count\n");
+        return 1;
+    }
+
+    if (!quiet) {
+        printf("ARG seed %lld\n", seed);
+        printf("ARG numInodes %ld\n", numInodes);
+        printf("ARG numData %ld\n", numData);
+        printf("ARG numRequests %ld\n", numRequests);
+        printf("ARG reverse %s\n", reverse ? "True" : "False");
+        printf("ARG printFinal %s\n", finalList ? "True" : "False");
+        printf("\n");
+    }
+
+    randomSeed(seed);
+    printOps = reverse || solve;
+    printState = !reverse || solve;
+    printFinal = finalList;
+    if (quiet) {
+        printOps = printState = false;
+    }
+
+    vsfsFormat(&gFs, image, numInodes, numData);
+    fileListInit(&files, numRequests + 1);
+    dirs = checkedMalloc((numRequests + 1) * sizeof(Entry));
+    dirs[dirCount++] = (Entry) { "/", 0, 0 };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long attempts = run(numRequests, batch);
+    vsfsUnmount(&gFs);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (quiet) {
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("vsfs: %ld operations (%ld attempted) in %.3f s, %.2f M ops/s; %ld flushes, %ld pages written\n",
+               numRequests, attempts, elapsed, attempts / elapsed / 1e6, gFs.flushes, gFs.pagesFlushed);
+    }
+    return 0;
+}